@@ -1,36 +1,339 @@
 /*
  * ADC.c
  *
- * Driver for the Analog to Digital Converter. 
+ * Driver for the Analog to Digital Converter.
+ *
+ * The converter is run from its own interrupt.  Each completed conversion
+ * starts the next one, so the main loop never waits on the ADC.  The
+ * channels to sample are listed in a table (s_Channels) below.  Channels
+ * with a RateDiv of 1 get their own slot in every frame.  All the other
+ * channels share one extra slot, which is given out round robin to the
+ * ones that are due.  This keeps the frame length, and therefore the
+ * sample rate of the fast channels, fixed no matter how many slow
+ * sensors are added.
+ *
+ * With the prescaler at 128 the ADC clock is 78KHz, and a conversion
+ * (including the restart from the ISR) takes 14 ADC clocks, or about
+ * 180us.  With three fast channels, the frame is four slots long, so
+ * the fast channels are sampled at about 1.4KHz.
+ *
+ * Code that needs to run at the sample rate can hook the end of each frame
+ * with ADC_SetFrameCallback().
+ *
+ * A burst (ADC_StartBurst()) takes over the converter for a while, to
+ * sample the current sense alone, evenly, at ADC_BURSTRATE.  The burst
+ * runs the ADC free running, so the sample times don't depend on how
+ * late the ISR is.  The current reading is still updated, so the
+ * overcurrent check keeps working, but the other channels and the frame
+ * callback wait until the burst is over.  So a burst can't be started
+ * while there is a frame callback.
+ *
+ * Each reading is filtered in the ISR and kept in 1/16 ADC counts.
+ * Conversion to engineering units is done by the reader, outside of the
+ * ISR, by ADC_Convert().
  *
  * Created: 5/18/2013 8:27:17 AM
  * Author: Dal
- */ 
+ */
 
 #include "MainDef.h"
+#include "SysClock.h"
 #include "ADC.h"
+#include "Tach.h"
+
+#define ZERO_SETTLE   500    // Time, in ms, that the motor must be idle before tracking the current zero.
+#define ZERO_FILTER   3      // Filter shift for the current zero estimate.  Time constant is 2^n samples.
+#define NO_CHAN       0xFF   // Marks a slot that has nothing to convert.
+
+// Burst states.
+#define BURST_OFF     0      // Scanning the channel table.
+#define BURST_WAIT    1      // Burst asked for.  Starts at the end of the current conversion.
+#define BURST_RUN     2      // Taking samples.
+#define BURST_END     3      // Waiting out the conversion started after the last sample.
+
+// Thermistor table: 10K NTC (B=3950) to ground, with a 10K pullup to 3.3V.
+// One entry every 64 counts, in 10th of degrees C.  The first entry is
+// clamped, since the curve goes to infinity there.
+static const PROGMEM int16_t s_Thermistor[17] =
+{
+	1500, 1114,  854,  710,  609,  530,  465,  407,  356,
+	 308,  263,  220,  177,  134,   90,   44,   -5
+};
+
+// The channel table.  The index into this table is the channel id in ADC.h.
+static const PROGMEM ADC_Channel s_Channels[ADC_NCHAN] =
+{
+	// Mux             Div  Filt  Conversion       Scale  Offset  LUT            LutShift
+	{ADC_BattVoltage,   1,    3,  ADC_CONV_LINEAR,  3552,     0,  NULL,          0},  // 13.875 mV per count
+	{ADC_PotInput,      1,    2,  ADC_CONV_RAW,        0,     0,  NULL,          0},
+	{ADC_CSense,        1,    0,  ADC_CONV_LINEAR,  6400,     0,  NULL,          0},  // 0.25 Amps per count
+	{ADC_MotorTemp,   100,    2,  ADC_CONV_LUT,        0,     0,  s_Thermistor,  6},
+	{ADC_CtrlTemp,    100,    2,  ADC_CONV_LUT,        0,     0,  s_Thermistor,  6},
+};
+
+static volatile int16_t  s_Reading[ADC_NCHAN];     // Filtered readings, in 1/16 counts.
+static volatile uint16_t s_iFrame = 0;             // Count of completed frames.
+static uint8_t  s_Fast[ADC_NCHAN];                 // Channel ids of the fast slots, in order.
+static uint8_t  s_nFast = 0;                       // Number of fast slots.  The shared slot follows.
+static uint8_t  s_Count[ADC_NCHAN];                // Frames till each slow channel is due.
+static uint8_t  s_iSlot = 0;                       // Slot being converted.
+static uint8_t  s_iConv = NO_CHAN;                 // Channel being converted.
+static uint8_t  s_iLastSlow = 0;                   // Last slow channel to be given the shared slot.
+static void (*s_pFrameCallback)() = NULL;          // Called from the ISR at the end of each frame.
+
+static volatile uint8_t s_iBurst = BURST_OFF;     // BURST_xxx.
+static int8_t  *s_pBurst = NULL;                   // Burst samples go here,
+static uint8_t  s_nBurst = 0;                      // this many of them,
+static uint8_t  s_iBurstPos = 0;
+static int16_t  s_iBurstRef = 0;                   // less this reference, in counts.
+
+static volatile int16_t s_iCurrentZero = 0;      // Filtered zero offset of the current sense, in 1/16 ADC counts.
+static bool8    s_bZeroValid = False;    // True once the first zero offset has been captured.
+static bool8    s_bIdle = False;         // True while the motor is known to be idle.
+static uint32_t s_tIdleStart = 0;        // Time (ms) when the motor became idle.
+
+static uint8_t NextSlowChannel();
+static void BurstSample(int16_t x);
 
 // -------------------------------------------------------
 // ADC_Enable()
-// Enables the ADC for use.   Requires power. Also, the
-// ADC should be enabled before calling the conversion
-// routines.
+// Enables the ADC for use.   Requires power.  Each channel
+// in the table is read once to prime its filter, and then
+// the interrupt driven scan is started.
 
 void ADC_Enable()
 {
     ADCSRA =
         (1 << ADEN)  |  // Enable the ADC unit
         (0 << ADSC)  |  // Don't start conversion yet
-        (0 << ADATE) |  // Don't use auto triggering yet
+        (0 << ADATE) |  // Don't use auto triggering, each conversion is started by the ISR
         (1 << ADIF)  |  // Clear interrupt flag (by writing 1 to it!)
-        (0 << ADIE)  |  // Not using interrupts in this implementation
-        (0x05 << ADPS0) ;  // Set Freq prescaler to divide by 16
+        (0 << ADIE)  |  // No interrupts while priming the filters
+        (0x07 << ADPS0) ;  // Set Freq prescaler to divide by 128
 
     ADCSRB = 0x00;  // Free Running Mode (Ignored, cause ADATE=0)
     ADMUX =
         (0x03 << REFS0) | // Use Internal 2.56V Reference
         (0 << ADLAR)    | // Set for right justified data
-        (0x00 << MUX0) ;  // The Mux selection.  Can be changed later.
+        (0x00 << MUX0) ;  // The Mux selection.  Changed by the ISR.
+
+	s_nFast = 0;
+	for(uint8_t i = 0; i < ADC_NCHAN; i++)
+	{
+		uint8_t mux = pgm_read_byte(&s_Channels[i].Mux);
+		s_Reading[i] = ADC_GetConversion(mux) << 4;
+		s_Count[i] = 0;
+		if(pgm_read_byte(&s_Channels[i].RateDiv) <= 1) s_Fast[s_nFast++] = i;
+	}
+
+	// Start the scan with the first slot.
+	s_iSlot = 0;
+	s_iConv = s_Fast[0];
+	ADMUX = (ADMUX & 0xF0) | pgm_read_byte(&s_Channels[s_iConv].Mux);
+	BitOn(ADCSRA, ADIE);
+	BitOn(ADCSRA, ADSC);
+}
+
+// --------------------------------------------------------
+// ISR()
+// Interrupt on ADC conversion complete.  Filters the reading
+// into its channel, and starts the conversion for the next slot.
+ISR(ADC_vect)
+{
+	int16_t x = ADC << 4;
+	if(s_iBurst >= BURST_RUN)
+	{
+		BurstSample(x);
+		return;
+	}
+	uint8_t i = s_iConv;
+	if(i != NO_CHAN)
+	{
+		uint8_t sh = pgm_read_byte(&s_Channels[i].FilterShift);
+		s_Reading[i] += (x - s_Reading[i]) >> sh;
+	}
+
+	bool8 bFrameDone = False;
+	s_iSlot++;
+	if(s_iSlot > s_nFast)
+	{
+		// End of the frame.
+		s_iSlot = 0;
+		s_iFrame++;
+		for(uint8_t k = 0; k < ADC_NCHAN; k++) if(s_Count[k]) s_Count[k]--;
+		bFrameDone = True;
+	}
+	if(s_iSlot < s_nFast) i = s_Fast[s_iSlot];
+	else                  i = NextSlowChannel();
+	s_iConv = i;
+	if(s_iBurst == BURST_WAIT)
+	{
+		// Start the burst now.  The slot just picked is converted after it.
+		s_iBurst = BURST_RUN;
+		ADMUX = (ADMUX & 0xF0) | ADC_CSense;
+		ADCSRA |= _BV(ADATE) | _BV(ADSC);
+	}
+	else
+	{
+		if(i != NO_CHAN) ADMUX = (ADMUX & 0xF0) | pgm_read_byte(&s_Channels[i].Mux);
+		BitOn(ADCSRA, ADSC);
+	}
+
+	// The next conversion is already running, so the frame callback
+	// does not disturb the sample timing.
+	if(bFrameDone && s_pFrameCallback) s_pFrameCallback();
+}
+
+// Picks the slow channel to get the shared slot in this frame,
+// round robin among the ones that are due.  Called from the ISR.
+static uint8_t NextSlowChannel()
+{
+	uint8_t i = s_iLastSlow;
+	for(uint8_t n = 0; n < ADC_NCHAN; n++)
+	{
+		if(++i >= ADC_NCHAN) i = 0;
+		uint8_t div = pgm_read_byte(&s_Channels[i].RateDiv);
+		if(div <= 1 || s_Count[i]) continue;
+		s_Count[i] = div;
+		s_iLastSlow = i;
+		return i;
+	}
+	return NO_CHAN;
+}
+
+// Takes one sample of a burst.  Called from the ISR.  In free running
+// mode, the next conversion has already started when this runs.
+static void BurstSample(int16_t x)
+{
+	s_Reading[ADC_CH_CURRENT] = x;           // The current channel has no filter.
+	if(s_iBurst == BURST_RUN)
+	{
+		int16_t d = (x >> 4) - s_iBurstRef;
+		if(d > 127) d = 127;
+		if(d < -127) d = -127;
+		s_pBurst[s_iBurstPos++] = d;
+		if(s_iBurstPos >= s_nBurst)
+		{
+			BitOff(ADCSRA, ADATE);
+			s_iBurst = BURST_END;
+		}
+		return;
+	}
+	// BURST_END: the last free running conversion is done, so the
+	// scan can go on with the slot it would have converted next.
+	s_iBurst = BURST_OFF;
+	if(s_iConv != NO_CHAN) ADMUX = (ADMUX & 0xF0) | pgm_read_byte(&s_Channels[s_iConv].Mux);
+	BitOn(ADCSRA, ADSC);
+}
+
+// -------------------------------------------------------
+// ADC_StartBurst()
+// Starts a burst of n samples of the current sense, at
+// ADC_BURSTRATE, into pBuf.  Each sample is kept in ADC counts,
+// less the current reading when the burst was asked for, and
+// clipped to +/-127.  Returns False if a burst is already running,
+// or there is a frame callback.  See ADC_IsBurstDone().
+bool8 ADC_StartBurst(int8_t *pBuf, uint8_t n)
+{
+	bool8 bOk = False;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		if(s_iBurst == BURST_OFF && s_pFrameCallback == NULL && n > 0)
+		{
+			s_pBurst = pBuf;
+			s_nBurst = n;
+			s_iBurstPos = 0;
+			s_iBurstRef = s_Reading[ADC_CH_CURRENT] >> 4;
+			s_iBurst = BURST_WAIT;
+			bOk = True;
+		}
+	}
+	return bOk;
+}
+
+// Returns True once the last burst is over, and the scan is running.
+bool8 ADC_IsBurstDone()
+{
+	return s_iBurst == BURST_OFF;
+}
+
+// -------------------------------------------------------
+// ADC_SetFrameCallback()
+// Sets a routine to be called at the end of every frame, when
+// all the fast channels hold fresh readings.  The callback runs
+// inside the ADC interrupt, so it must be short -- well under
+// one conversion time.  Pass NULL to remove it.
+void ADC_SetFrameCallback(void (*pCallback)())
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		s_pFrameCallback = pCallback;
+	}
+}
+
+// -------------------------------------------------------
+// ADC_GetSnapshot()
+// Copies all the filtered readings, as they were at one
+// instant, into the given snapshot, with the tach speed.
+void ADC_GetSnapshot(ADC_Snapshot *pSnap)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		pSnap->Frame = s_iFrame;
+		for(uint8_t i = 0; i < ADC_NCHAN; i++) pSnap->Reading[i] = s_Reading[i];
+		pSnap->Rpm = Tach_GetRpm();
+	}
+}
+
+// -------------------------------------------------------
+// ADC_GetReading()
+// Returns the filtered reading for one channel, in 1/16
+// ADC counts.
+int16_t ADC_GetReading(uint8_t iChan)
+{
+	int16_t d;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		d = s_Reading[iChan];
+	}
+	return d;
+}
+
+// -------------------------------------------------------
+// ADC_Convert()
+// Converts a reading (in 1/16 counts) for the given channel
+// into engineering units, according to the channel table.
+int16_t ADC_Convert(uint8_t iChan, int16_t Reading)
+{
+	const ADC_Channel *pC = &s_Channels[iChan];
+	uint8_t conv = pgm_read_byte(&pC->ConvType);
+	if(conv == ADC_CONV_LINEAR)
+	{
+		int32_t d = (int32_t) Reading * (int16_t) pgm_read_word(&pC->Scale);
+		return (int16_t) ((d + 2048) >> 12) + (int16_t) pgm_read_word(&pC->Offset);
+	}
+	if(conv == ADC_CONV_LUT)
+	{
+		// The table has one entry every 2^LutShift counts, so the
+		// index and the fraction are just the bits of the reading.
+		const int16_t *pLut = (const int16_t *) pgm_read_word(&pC->pLut);
+		uint8_t sh = pgm_read_byte(&pC->LutShift) + 4;
+		if(Reading < 0) Reading = 0;
+		uint8_t k = Reading >> sh;
+		int16_t frac = Reading & ((1 << sh) - 1);
+		int16_t y0 = pgm_read_word(pLut + k);
+		int16_t y1 = pgm_read_word(pLut + k + 1);
+		return y0 + (int16_t) (((int32_t) (y1 - y0) * frac) >> sh);
+	}
+	return (Reading + 8) >> 4;
+}
+
+// -------------------------------------------------------
+// ADC_GetSensor()
+// Returns the latest value for a channel, in engineering units.
+int16_t ADC_GetSensor(uint8_t iChan)
+{
+	return ADC_Convert(iChan, ADC_GetReading(iChan));
 }
 
 // -------------------------------------------------------
@@ -44,49 +347,90 @@ int16_t ADC_GetBatteryVoltage()
 	// Now, we want the voltage before the 10K/2.2K voltage divider.  Therefore scale again
 	// by 12.2/2.2 = 5.55. (By measurement, it is actually 5.50).  Finally, total scale factor
 	// to apply is 13.875. (Or, by measurement 13.763). This will convert the
-	// ADC reading to mV.
-	
-    int16_t d = ADC_GetConversion(ADC_BattVoltage);   // Gets the voltage reading.
-	int16_t d2 = d >> 1;
-	int16_t d4 = d >> 2;
-	int16_t d8 = d >> 3;
-	int16_t d16 = 0; //d >> 4;
-	d = (d * 13) + d2 + d4 + d8 + d16;
-    return d;
+	// ADC reading to mV.  See the scale in the channel table.
+
+    return ADC_GetSensor(ADC_CH_BATT);
 }
 
 int16_t ADC_GetPot()
 {
 	// The Pot is a simple voltage diver, from 0 to 3.3 volts.
-	int16_t d = ADC_GetConversion(ADC_PotInput);	// Gets the pot setting.
-	return d;
-	//if (d != f) {
-		//refreshTimer()
-	//}
+	return ADC_GetSensor(ADC_CH_POT);
 }
 
 // -------------------------------------------------------
 // ADC_GetCurrent()
-// Returns current in 100th of Amps.
+// Returns current in 100th of Amps.  The zero offset captured
+// by ADC_TrackCurrentZero() is removed, so the result can be
+// slightly negative when the motor is idle.
 int16_t ADC_GetCurrent()
 {
-	// The current is run though a 0.01 ohm shut resistor.  Therefore, 100 Amps 
-	// would produce one volt.  Full scale is 2.56 volts or 256 Amps.  The 
+	// The current is run though a 0.01 ohm shut resistor.  Therefore, 100 Amps
+	// would produce one volt.  Full scale is 2.56 volts or 256 Amps.  The
 	// reading at full scale is 1023.  Therefore the LSB = 256Amps/1023 =
 	// 0.25amps or 250 mA.
-	int16_t d = ADC_GetConversion(ADC_CSense);
-	d = 25*d;  // for 100th of amp, not mA.
-    return d;
+	return ADC_Convert(ADC_CH_CURRENT, ADC_GetReading(ADC_CH_CURRENT) - s_iCurrentZero);
  }
 
+// -------------------------------------------------------
+// ADC_TrackCurrentZero()
+// Called every control tick, from Control_Tick(), so that it
+// sees the motor run whatever screen is up.  bIdle should be
+// True whenever the shunt must be carrying no current -- the
+// motor relay is open or the PWM is at neutral.  Once the motor
+// has been idle for ZERO_SETTLE ms, each call takes a sample of
+// the current sense and folds it into a filtered estimate of
+// the zero offset, which is then removed by ADC_GetCurrent().
+void ADC_TrackCurrentZero(bool8 bIdle)
+{
+	if(!bIdle)
+	{
+		s_bIdle = False;
+		return;
+	}
+	uint32_t t = GetSystemTime();
+	if(!s_bIdle)
+	{
+		s_bIdle = True;
+		s_tIdleStart = t;
+		return;
+	}
+	if(t - s_tIdleStart < ZERO_SETTLE) return;
+
+	int16_t d = ADC_GetReading(ADC_CH_CURRENT);
+	int16_t z = s_iCurrentZero;
+	if(!s_bZeroValid)
+	{
+		z = d;   // First capture: take it as is.
+		s_bZeroValid = True;
+	}
+	else
+	{
+		z += (d - z) >> ZERO_FILTER;
+	}
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		s_iCurrentZero = z;   // Also used from interrupts.
+	}
+}
+
+// -------------------------------------------------------
+// ADC_GetCurrentZero()
+// Returns the current zero offset, in 100th of Amps.
+int16_t ADC_GetCurrentZero()
+{
+	return ADC_Convert(ADC_CH_CURRENT, s_iCurrentZero);
+}
+
  // -------------------------------------------------------
  // ADC_GetConversion()
  // Reads one value from the ADC converter and returns it.
  // Blocks until conversion is done -- usually takes about
- // 47uS with the prescaler set to divide by 32 and the 
- // system clock at 10Mhz.  (Its 30us for a division by 16).
- // Assumes that ADC_Enable() has been called first.
- 
+ // 180uS with the prescaler set to divide by 128 and the
+ // system clock at 10Mhz.  Used to prime the filters before
+ // the scan is started.  Do not call once ADC_Enable() has
+ // returned -- the ISR owns the converter after that.
+
  int16_t ADC_GetConversion(uint8_t iChannel)
  {
     ADMUX = (ADMUX & 0xF0) | iChannel;
@@ -95,4 +439,4 @@ int16_t ADC_GetCurrent()
     int16_t Data = ADC;               // Grab the data
     BitOn(ADCSRA, ADIF);              // Clear the "done" flag
     return Data;
- }
\ No newline at end of file
+ }
@@ -8,11 +8,55 @@
 #ifndef ADC_H_
 #define ADC_H_
 
+// Channel ids.  These index the channel table in ADC.c, and the readings
+// in the snapshot.  The mux numbers are in MainDef.h.
+#define ADC_CH_BATT       0     // Battery voltage, in mV.
+#define ADC_CH_POT        1     // Pot position, in ADC counts.
+#define ADC_CH_CURRENT    2     // Motor current, in 100th of Amps.
+#define ADC_CH_MOTORTEMP  3     // Motor case thermistor, in 10th of degrees C.
+#define ADC_CH_CTRLTEMP   4     // Controller thermistor, in 10th of degrees C.
+#define ADC_NCHAN         5
+
+#define ADC_FRAMERATE     1395  // Frames per second: F_CPU / (128 * 14 * 4).
+#define ADC_BURSTRATE     6010  // Burst samples per second: F_CPU / (128 * 13), free running.
+
+// Conversion types for the channel table.
+#define ADC_CONV_RAW      0     // Value is the reading, in ADC counts.
+#define ADC_CONV_LINEAR   1     // Value = Counts * Scale / 256 + Offset.
+#define ADC_CONV_LUT      2     // Value interpolated from an evenly spaced table in PROGMEM.
+
+typedef struct
+{
+	uint8_t Mux;                // ADC mux selection (0-7).
+	uint8_t RateDiv;            // Sample once every RateDiv frames.  1 = a dedicated slot in every frame.
+	uint8_t FilterShift;        // IIR filter: y += (x - y) >> FilterShift.  0 = no filtering.
+	uint8_t ConvType;           // One of ADC_CONV_xxx.
+	int16_t Scale;              // Linear: multiplier from counts to units, in 1/256ths.
+	int16_t Offset;             // Linear: added after scaling.
+	const int16_t *pLut;        // LUT: table in PROGMEM, (1024 >> LutShift) + 1 entries.
+	uint8_t LutShift;           // LUT: log2 of the spacing of the table, in counts.
+} ADC_Channel;
+
+typedef struct
+{
+	uint16_t Frame;                 // Count of completed frames.
+	int16_t Reading[ADC_NCHAN];     // Filtered readings, in 1/16 ADC counts.
+	int16_t Rpm;                    // Speed from the tach, in RPM.  0 if there is no tach.
+} ADC_Snapshot;
+
 void ADC_Enable();
 int16_t ADC_GetBatteryVoltage();
 int16_t ADC_GetPot();
 int16_t ADC_GetCurrent();
+void ADC_TrackCurrentZero(bool8 bIdle);
+int16_t ADC_GetCurrentZero();
+int16_t ADC_GetSensor(uint8_t iChan);
+int16_t ADC_GetReading(uint8_t iChan);
+int16_t ADC_Convert(uint8_t iChan, int16_t Reading);
+void ADC_GetSnapshot(ADC_Snapshot *pSnap);
+void ADC_SetFrameCallback(void (*pCallback)());
+bool8 ADC_StartBurst(int8_t *pBuf, uint8_t n);
+bool8 ADC_IsBurstDone();
 int16_t ADC_GetConversion(uint8_t iChannel);
 
 #endif /* ADC_H_ */
-
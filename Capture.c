@@ -0,0 +1,233 @@
+/*
+ * Capture.c
+ *
+ * Measures the PWM signal from a robot's controller, plugged into the
+ * spare PD2 (INT0) and PD3 (INT1) pins.  Each pin interrupts on both
+ * edges, and the edges are stamped with PWM_GetCycles(), which is Timer1
+ * extended to 32 bits, in CPU cycles (0.1us).  So the capture only works
+ * while the PWM is on, which it always is.
+ *
+ * The numbers are worked out in the ISR as the edges come in: the width
+ * on each falling edge, the period on each rising edge, the min and max
+ * of the width, and running averages (shift-4 IIR) of the width, the
+ * period, and of how far each width is from the average (the jitter).
+ *
+ * With pass-through on, each width measured on channel 0 is sent on to
+ * the PWM through Control_Output(), like any other drive, so a latched
+ * fault holds it at neutral, and the stall throttle, the thermal derate
+ * and the battery correction all apply.  If no good pulse comes in for
+ * CAP_LOSTMS (the cable is out, or the robot's controller is off), a
+ * scheduler timer sets the output back to neutral until one does.  The
+ * latency added is from the falling edge that ended the input pulse to
+ * the start of the output period that first carries it
+ * (PWM_GetMailCycles()).  It is found on the next falling edge, when the
+ * last width has surely been taken.
+ *
+ * Created: 10/18/2026
+ */
+
+#include "MainDef.h"
+#include "PWM.h"
+#include "Control.h"
+#include "Sched.h"
+#include "Capture.h"
+
+#define CAP_SHIFT      4        // Running averages: shift-4 IIR.
+#define CAP_MINWIDTH   5000     // Pass-through only widths from 500us
+#define CAP_MAXWIDTH   25000    // to 2500us, in CPU cycles.
+#define CAP_LOSTMS     60       // Pass-through goes to neutral after this long with no good pulse.
+#define CAP_WATCHMS    20       // How often that is checked.
+#define CAP_Q4MUL      ((uint32_t) (16.0 * 16384 * 1000000 / F_CPU + 0.5))   // Cycles to 1/16 usecs, in 1/16384ths.  No division in the ISR.
+
+typedef struct
+{
+	uint32_t Rise;             // Time of the last rising edge.
+	bool8 bRise;               // True if Rise is good.
+	CapStats Stats;
+} CapChan;
+
+static CapChan s_Chan[CAP_NCHAN];
+static volatile bool8 s_bPass = False;      // True to pass channel 0 on to the PWM.
+static bool8 s_bPassPending = False;        // True if a width was passed on, and its latency not yet found.
+static uint32_t s_iPassIn = 0;              // Falling edge of the pulse passed on.
+static volatile uint16_t s_iLatency = 0;    // Last pass-through latency, in CPU cycles.
+static volatile uint16_t s_iMaxLatency = 0; // Most pass-through latency, in CPU cycles.
+static uint32_t s_iLastPass = 0;            // Falling edge of the last good pulse on channel 0.
+static bool8 s_bLost = False;               // True if pass-through is at neutral for want of a signal.
+static uint8_t s_iWatch = SCHED_NONE;       // Loss of signal timer.
+
+static void Watch();
+static void Edge(uint8_t iChan, bool8 bHigh);
+
+// --------------------------------------------------------
+// Capture_Start()
+// Sets up the pins as inputs, and starts measuring.
+void Capture_Start()
+{
+	BitOff(DDRD, DSpare2);
+	BitOff(DDRD, DSpare3);
+	Capture_Reset();
+	EICRA = (0<<ISC11)|(1<<ISC10)|(0<<ISC01)|(1<<ISC00);   // Both pins: any edge.
+	EIFR = _BV(INTF0) | _BV(INTF1);
+	EIMSK |= _BV(INT0) | _BV(INT1);
+}
+
+// Stops measuring, and turns pass-through off.
+void Capture_Stop()
+{
+	EIMSK &= ~(_BV(INT0) | _BV(INT1));
+	Capture_SetPassThrough(False);
+}
+
+// Clears the numbers.
+void Capture_Reset()
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		for(uint8_t i = 0; i < CAP_NCHAN; i++)
+		{
+			s_Chan[i].bRise = False;
+			s_Chan[i].Stats.n = 0;
+		}
+		s_bPassPending = False;
+		s_iLatency = 0;
+		s_iMaxLatency = 0;
+	}
+}
+
+// Copies out the numbers for a channel.
+void Capture_GetStats(uint8_t iChan, CapStats *pStats)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		*pStats = s_Chan[iChan].Stats;
+	}
+}
+
+// Turns passing channel 0 on to the PWM on or off.  Returns False,
+// and leaves it off, if there is no scheduler timer free for the loss
+// of signal check.
+bool8 Capture_SetPassThrough(bool8 bOn)
+{
+	if(s_iWatch != SCHED_NONE)
+	{
+		Sched_Cancel(s_iWatch);
+		s_iWatch = SCHED_NONE;
+	}
+	if(bOn) s_iWatch = Sched_Add(Watch, CAP_WATCHMS, CAP_WATCHMS, SCHED_ISR);
+	if(s_iWatch == SCHED_NONE) bOn = False;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		s_bPass = bOn;
+		s_bPassPending = False;
+		s_iLastPass = PWM_GetCycles();
+		s_bLost = False;
+	}
+	return bOn;
+}
+
+bool8 Capture_IsPassThrough()
+{
+	return s_bPass;
+}
+
+// Returns the pass-through latency, in CPU cycles: the last one,
+// or the most.
+uint16_t Capture_GetLatency(bool8 bMax)
+{
+	uint16_t v;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { v = bMax ? s_iMaxLatency : s_iLatency; }
+	return v;
+}
+
+// Loss of signal check, from the scheduler tick.  If no good pulse
+// has been passed on for CAP_LOSTMS, the output goes to neutral.
+static void Watch()
+{
+	if(!s_bPass || s_bLost) return;
+	if(PWM_GetCycles() - s_iLastPass < (uint32_t) CAP_LOSTMS * (F_CPU / 1000)) return;
+	PWM_SetWidth(CTL_NEUTRAL);
+	s_bPassPending = False;
+	s_bLost = True;
+}
+
+ISR(INT0_vect)
+{
+	Edge(0, BitTest(PIND, DSpare2));
+}
+
+ISR(INT1_vect)
+{
+	Edge(1, BitTest(PIND, DSpare3));
+}
+
+// Handles an edge on a channel.  bHigh is the level after the edge.
+static void Edge(uint8_t iChan, bool8 bHigh)
+{
+	uint32_t t = PWM_GetCycles();
+	CapChan *pC = &s_Chan[iChan];
+	CapStats *pS = &pC->Stats;
+
+	if(bHigh)
+	{
+		if(pC->bRise)
+		{
+			pS->Period = t - pC->Rise;
+			if(pS->n <= 1) pS->PeriodAvg = pS->Period;
+			else pS->PeriodAvg += ((int32_t) (pS->Period - pS->PeriodAvg)) >> CAP_SHIFT;
+		}
+		pC->Rise = t;
+		pC->bRise = True;
+		return;
+	}
+	if(!pC->bRise) return;
+	uint32_t w32 = t - pC->Rise;
+	uint16_t w = (w32 > 65535) ? 65535 : w32;
+	pS->Width = w;
+	if(pS->n == 0)
+	{
+		pS->WidthMin = w;
+		pS->WidthMax = w;
+		pS->WidthAvg = w;
+		pS->Jitter = 0;
+	}
+	else
+	{
+		if(w < pS->WidthMin) pS->WidthMin = w;
+		if(w > pS->WidthMax) pS->WidthMax = w;
+		int16_t d = (int16_t) (w - pS->WidthAvg);
+		pS->WidthAvg += d >> CAP_SHIFT;
+		if(d < 0) d = -d;
+		pS->Jitter += (d - (int16_t) pS->Jitter) >> CAP_SHIFT;
+	}
+	if(pS->n < 65535) pS->n++;
+
+	if(iChan == 0 && s_bPass)
+	{
+		if(s_bPassPending)
+		{
+			int32_t lat = PWM_GetMailCycles() - s_iPassIn;
+			if(lat > 0 && lat < 65536)
+			{
+				s_iLatency = lat;
+				if(lat > s_iMaxLatency) s_iMaxLatency = lat;
+			}
+		}
+		s_bPassPending = False;
+		if(w >= CAP_MINWIDTH && w <= CAP_MAXWIDTH)
+		{
+			// The offset from neutral goes through Control_Output() in
+			// usecs.  If it comes back the same, the 1/16ths are kept.
+			int16_t q = (int16_t) ((((uint32_t) w * CAP_Q4MUL + 8192) >> 14) - (CTL_NEUTRAL << 4));
+			int16_t u = q >> 4;
+			int16_t out = Control_Output(u);
+			if(Control_GetFault()) q = 0;
+			else if(out != u) q = out << 4;
+			PWM_SetWidthQ4((CTL_NEUTRAL << 4) + q);
+			s_iPassIn = t;
+			s_iLastPass = t;
+			s_bLost = False;
+			s_bPassPending = True;
+		}
+	}
+}
@@ -0,0 +1,36 @@
+/*
+ * Capture.h
+ *
+ * Measures incoming PWM signals on the spare PD2 and PD3 pins.
+ *
+ * Created: 10/18/2026
+ */
+
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+
+#include "MainDef.h"
+
+#define CAP_NCHAN   2          // Channel 0 is DSpare2 (INT0), 1 is DSpare3 (INT1).
+
+typedef struct
+{
+	uint16_t n;                // Pulses measured.
+	uint16_t Width;            // Last pulse width, in CPU cycles.
+	uint16_t WidthMin;         // Shortest and longest pulse, in CPU cycles.
+	uint16_t WidthMax;
+	uint16_t WidthAvg;         // Running average of the width, in CPU cycles.
+	uint16_t Jitter;           // Running average of |Width - WidthAvg|, in CPU cycles.
+	uint32_t Period;           // Last period, rising edge to rising edge, in CPU cycles.
+	uint32_t PeriodAvg;        // Running average of the period, in CPU cycles.
+} CapStats;
+
+void Capture_Start();
+void Capture_Stop();
+void Capture_Reset();
+void Capture_GetStats(uint8_t iChan, CapStats *pStats);
+bool8 Capture_SetPassThrough(bool8 bOn);
+bool8 Capture_IsPassThrough();
+uint16_t Capture_GetLatency(bool8 bMax);
+
+#endif /* CAPTURE_H_ */
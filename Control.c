@@ -0,0 +1,417 @@
+/*
+ * Control.c
+ *
+ * The control law that turns a commanded pulse width into the width
+ * actually sent to the PWM module.
+ *
+ * Control_Tick() is hooked to the PWM tick (PWM_TICKRATE per second, in
+ * the Timer1 overflow interrupt).  It checks for faults and then runs the
+ * background tasks, such as the tach window and the profile engine.
+ * A fault stays latched until Control_ClearFault(); anything driving the
+ * motor should stop when Control_GetFault() is not zero.
+ *
+ * Battery sag compensation: as the battery sags under load, the same
+ * width offset from neutral gives less motor voltage.  When turned on,
+ * the offset is scaled by Vnominal/Vmeasured.  The factor is kept in Q12
+ * and is updated with one Newton-Raphson step per control call, so no
+ * division is needed at the control rate:
+ *
+ *     f' = f * (2 - f * V / Vnominal)
+ *
+ * 1/Vnominal is found once, in Control_Setup().  Since the battery
+ * changes slowly compared to the control rate, a single step per call
+ * is enough to track it.
+ *
+ * Run mode drive: while Control_Drive() is on, the width is set in the
+ * tick from the command given with Control_SetCommand() and the
+ * direction.  A direction change asked for with Control_Reverse() is
+ * done by a small state machine in the tick: the output goes to neutral
+ * at the ramp decel rate, holds there for eeRevDwell, and then the
+ * direction is flipped and the output goes back to the command at the
+ * ramp accel rate.  So the pot can be left where it is.
+ *
+ * Fast control: the width itself is worked out by Control_Fast(), hooked
+ * to the fast timer interrupt (EnableFastTimerInterrupt()) at eeCtlRate
+ * per second, so it runs at a fixed rate whatever the UI loop is doing.
+ * With Control_SetPotCommand() on, it reads the pot and shapes it itself,
+ * so the LCD doesn't hold up the pot either.  The reversal state machine
+ * stays in the tick, as its times are in ticks.  With eeCtlRate at 0,
+ * all of it runs in the tick, as before.
+ *
+ * Stall detection: a stalled motor draws a high, flat current while the
+ * width is away from neutral.  Each tick, the current is compared with a
+ * running average (a shift-3 IIR).  If the width is at least eeStallMinCmd
+ * from neutral, the current is over eeStallAmps, and it is within 1/8 of
+ * the average, a counter is advanced; otherwise it is reset.  When the
+ * counter reaches eeStallTime, the stall action is taken: either the
+ * output is cut with a latched CTL_FAULT_STALL, or it is throttled to half
+ * until the command comes back to neutral.  The time of the stall and the
+ * cycles spent in the detector are kept for the fault screen.
+ *
+ * Thermal protection: the I^2t model in Thermal.c is run each tick.  The
+ * output is scaled by its derate factor, and a trip latches
+ * CTL_FAULT_THERMAL.  The trip is checked every tick, so clearing the
+ * fault while the motor is still hot doesn't clear it for long.
+ *
+ * Created: 10/18/2026
+ */ 
+
+#include "MainDef.h"
+#include "ADC.h"
+#include "PWM.h"
+#include "Profile.h"
+#include "PotCurve.h"
+#include "Tach.h"
+#include "Thermal.h"
+#include "SysClock.h"
+#include "Control.h"
+
+#define COMP_MINVOLTS  5000          // Below this (mV), the battery reading is not trusted.
+#define COMP_MAX       (CTL_ONE*3/2) // Largest correction allowed.
+#define CTL_MINRATE    PWM_TICKRATE  // Slowest fast control rate.  Keeps the interval in 16 bits.
+
+static bool8    s_bComp = False;         // True if battery compensation is on.
+static int32_t  s_iNomRecip = 0;         // 2^28 / Vnominal.
+static uint16_t s_iFactor = CTL_ONE;     // Correction factor, Q12.
+static int16_t  s_iCurLimit = 0;         // Overcurrent fault level, 100th of Amps.
+static volatile uint8_t s_iFault = 0;    // Latched fault bits, CTL_FAULT_xxx.
+static uint8_t  s_iStallAction = 0;      // CTL_STALL_xxx.
+static int16_t  s_iStallAmps = 0;        // Stall settings, loaded from EEPROM.
+static int16_t  s_iStallMinCmd = 0;
+static uint16_t s_nStallTicks = 0;
+static uint16_t s_iStallCount = 0;       // Ticks that have looked like a stall.
+static int16_t  s_iStallAvg = 0;         // Running average of the current.
+static volatile bool8 s_bThrottle = False;       // True while throttled by a stall.
+static volatile uint32_t s_iStallTime = 0;       // System time of the last stall, in msecs.  0 = none.
+static volatile uint16_t s_iStallCost = 0;       // Cycles spent in the detector, last tick.
+static volatile uint16_t s_iStallMaxCost = 0;    // Most cycles spent in the detector.
+
+static volatile bool8 s_bDrive = False; // True while the tick drives the width.
+static volatile bool8 s_bForward = True; // Drive direction.
+static volatile int16_t s_iCommand = 0;  // Commanded width offset, in usecs.
+static volatile uint8_t s_iRevState = CTL_REV_NONE;   // Reversal state.
+static uint16_t s_nRevDwell = 0;         // Dwell at neutral, in ticks.
+static uint16_t s_iRevCount = 0;         // Ticks left in the dwell.
+static volatile bool8 s_bPotCmd = False; // True to take the command from the pot.
+static bool8    s_bFast = False;         // True if Control_Fast() is running.
+
+static void CheckStall();
+static void DriveTick();
+static void DriveOutput();
+static void Control_Fast();
+
+static void Control_Tick();
+
+// --------------------------------------------------------
+// Control_Setup()
+// Loads the settings from EEPROM.  Call before running the
+// motor, and after the settings are changed.
+void Control_Setup()
+{
+	s_bComp = eeprom_read_byte(&eeBattComp) ? True : False;
+	uint16_t vNom = eeprom_read_word(&eeBattNominal);
+	if(vNom < COMP_MINVOLTS) vNom = COMP_MINVOLTS;
+	s_iNomRecip = (1L << 28) / vNom;
+	s_iFactor = CTL_ONE;
+	PWM_SetRamp(eeprom_read_word(&eeRampAccel), eeprom_read_word(&eeRampDecel));
+	PWM_SetHBridge(eeprom_read_byte(&eeHbBrake), eeprom_read_word(&eeHbDead));
+	PWM_SetDither(eeprom_read_byte(&eePwmDither));
+	s_iCurLimit = eeprom_read_word((uint16_t *) &eeCurLimit);
+	s_iStallAction = eeprom_read_byte(&eeStallAction);
+	s_iStallAmps = eeprom_read_word((uint16_t *) &eeStallAmps);
+	s_iStallMinCmd = eeprom_read_word((uint16_t *) &eeStallMinCmd);
+	s_nStallTicks = ((uint32_t) eeprom_read_word(&eeStallTime) * PWM_TICKRATE) / 1000;
+	s_iStallCount = 0;
+	s_bThrottle = False;
+	s_nRevDwell = ((uint32_t) eeprom_read_word(&eeRevDwell) * PWM_TICKRATE) / 1000;
+	PotCurve_Setup();
+	Tach_Setup();
+	Thermal_Setup();
+	PWM_SetTickCallback(Control_Tick);
+	uint16_t rate = eeprom_read_word(&eeCtlRate);
+	if(rate != 0 && rate < CTL_MINRATE) rate = CTL_MINRATE;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		s_bFast = (rate != 0);
+		if(s_bFast) EnableFastTimerInterrupt(Control_Fast, 1000000UL / rate);
+		else DisableFastTimerInterrupt();
+	}
+}
+
+// --------------------------------------------------------
+// Control_Tick()
+// Runs once per PWM tick, from the Timer1 overflow interrupt.  At
+// the fast PWM rates, it runs with interrupts on (see PWM.c), so the
+// faults are latched with Control_SetFault().
+static void Control_Tick()
+{
+	if(ADC_GetCurrent() > s_iCurLimit) Control_SetFault(CTL_FAULT_OVERCURRENT);
+	ADC_TrackCurrentZero(!BitTest(PORTC, MotorRlyPin) || PWM_GetWidth() == CTL_NEUTRAL);
+	Tach_Tick();
+	if(Thermal_Tick()) Control_SetFault(CTL_FAULT_THERMAL);
+	if(s_iStallAction != CTL_STALL_OFF)
+	{
+		uint32_t t0 = PWM_GetCycles();
+		CheckStall();
+		uint16_t dt = PWM_GetCycles() - t0;
+		s_iStallCost = dt;
+		if(dt > s_iStallMaxCost) s_iStallMaxCost = dt;
+	}
+	if(s_bDrive) DriveTick();
+	Profile_Tick();
+}
+
+// --------------------------------------------------------
+// Control_Fast()
+// Runs at eeCtlRate, from the fast timer interrupt.
+static void Control_Fast()
+{
+	if(!s_bDrive) return;
+	if(s_bPotCmd) s_iCommand = PotCurve_Shape(ADC_GetPot());
+	DriveOutput();
+}
+
+// Runs the reversal state machine, and, if Control_Fast() is not
+// running, sets the width.  See the notes at the top.
+static void DriveTick()
+{
+	switch(s_iRevState)
+	{
+		case CTL_REV_DECEL:
+			if(PWM_GetWidth() != CTL_NEUTRAL) break;
+			s_iRevState = CTL_REV_DWELL;
+			s_iRevCount = s_nRevDwell;
+			// Fall through.
+		case CTL_REV_DWELL:
+			if(s_iRevCount > 0)
+			{
+				s_iRevCount--;
+				break;
+			}
+			s_bForward = !s_bForward;
+			s_iRevState = CTL_REV_NONE;
+			break;
+	}
+	if(s_bFast) return;
+	if(s_bPotCmd) s_iCommand = PotCurve_Shape(ADC_GetPot());
+	DriveOutput();
+}
+
+// Sets the width from the command and direction.  Neutral while
+// reversing.
+static void DriveOutput()
+{
+	int16_t cmd = (s_iRevState == CTL_REV_NONE) ? s_iCommand : 0;
+	if(!s_bForward) cmd = -cmd;
+	PWM_SetWidth(CTL_NEUTRAL + Control_Output(cmd));
+}
+
+// --------------------------------------------------------
+// Control_Drive()
+// Starts or stops driving the width from the tick, in the given
+// direction.  When stopped, the width is returned to neutral.
+void Control_Drive(bool8 bOn, bool8 forward)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		s_bForward = forward;
+		s_iRevState = CTL_REV_NONE;
+		s_bDrive = bOn;
+		if(!bOn)
+		{
+			s_bPotCmd = False;
+			s_iCommand = 0;
+			PWM_SetWidth(CTL_NEUTRAL);
+		}
+	}
+}
+
+// Sets the command for the drive: a width offset from neutral, in
+// usecs, before the direction is applied.
+void Control_SetCommand(int16_t offset)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		s_iCommand = offset;
+	}
+}
+
+// Takes the command from the pot (True), shaped by the pot curve, at
+// the control rate, instead of from Control_SetCommand().  Turned off
+// when the drive stops.
+void Control_SetPotCommand(bool8 bOn)
+{
+	s_bPotCmd = bOn;
+}
+
+// Asks for the drive direction to be reversed.  Does nothing if a
+// reversal is already under way.
+void Control_Reverse()
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		if(s_iRevState == CTL_REV_NONE) s_iRevState = CTL_REV_DECEL;
+	}
+}
+
+// Returns the drive direction.  During a reversal, this is the old
+// direction until the dwell is over.
+bool8 Control_IsForward()
+{
+	return s_bForward;
+}
+
+// Returns CTL_REV_NONE, CTL_REV_DECEL or CTL_REV_DWELL.
+uint8_t Control_GetRevState()
+{
+	return s_iRevState;
+}
+
+// One step of the stall detector.  See the notes at the top.
+static void CheckStall()
+{
+	int16_t i = ADC_GetCurrent();
+	int16_t cmd = (int16_t) PWM_GetWidth() - CTL_NEUTRAL;
+	if(cmd < 0) cmd = -cmd;
+	s_iStallAvg += (i - s_iStallAvg) >> 3;
+	if(cmd < s_iStallMinCmd)
+	{
+		s_bThrottle = False;
+		s_iStallCount = 0;
+		return;
+	}
+	int16_t dev = i - s_iStallAvg;
+	if(dev < 0) dev = -dev;
+	if(i < s_iStallAmps || dev > (s_iStallAvg >> 3))
+	{
+		s_iStallCount = 0;
+		return;
+	}
+	if(++s_iStallCount < s_nStallTicks) return;
+	s_iStallCount = 0;
+	s_iStallTime = GetSystemTime();
+	if(s_iStallAction == CTL_STALL_CUT)
+	{
+		Control_SetFault(CTL_FAULT_STALL);
+		PWM_SetWidth(CTL_NEUTRAL);
+	}
+	else s_bThrottle = True;
+}
+
+// --------------------------------------------------------
+// Control_SetFault()
+// Latches one or more fault bits.
+void Control_SetFault(uint8_t fault)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		s_iFault |= fault;
+	}
+}
+
+// Returns the latched fault bits.  Zero means no fault.
+uint8_t Control_GetFault()
+{
+	return s_iFault;
+}
+
+// Clears all the faults.
+void Control_ClearFault()
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		s_iFault = 0;
+		s_iStallCount = 0;
+		s_bThrottle = False;
+	}
+}
+
+// --------------------------------------------------------
+// Control_Output()
+// Given the commanded width offset from neutral, in usecs,
+// returns the offset to output.  Gives zero if there is a fault,
+// halves it while throttled by a stall, derates it when the
+// motor is hot, and then corrects it for battery sag.  Every
+// path that drives the motor goes through here: the Run mode
+// drive, the sweep, the endurance test, width profiles, the
+// current loop and pass-through.  Only one of them runs at a
+// time, so the battery correction's estimate has one caller,
+// at that path's rate.
+int16_t Control_Output(int16_t offset)
+{
+	if(s_iFault) return 0;
+	if(s_bThrottle) offset /= 2;
+	offset = ((int32_t) offset * Thermal_GetDerate()) >> 12;
+	return Control_Compensate(offset);
+}
+
+// Returns the system time of the last stall, in msecs.  Zero if
+// there has not been one.
+uint32_t Control_GetStallTime()
+{
+	uint32_t t;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { t = s_iStallTime; }
+	return t;
+}
+
+// Returns the CPU cycles spent in the stall detector: in the last
+// tick, and the most in any tick.
+uint16_t Control_GetStallCost(bool8 bMax)
+{
+	uint16_t v;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { v = bMax ? s_iStallMaxCost : s_iStallCost; }
+	return v;
+}
+
+// Returns True while the output is throttled by a stall.
+bool8 Control_IsThrottled()
+{
+	return s_bThrottle;
+}
+
+// --------------------------------------------------------
+// Control_Compensate()
+// Given a width offset from neutral, in usecs, returns the
+// offset corrected for battery sag.  Also advances the estimate
+// of the correction factor by one step.  Call at the control rate.
+int16_t Control_Compensate(int16_t offset)
+{
+	if(!s_bComp) return offset;
+
+	int32_t v = ADC_GetBatteryVoltage();
+	if(v < COMP_MINVOLTS)
+	{
+		// No battery, or a bad reading.  Don't correct.
+		s_iFactor = CTL_ONE;
+		return offset;
+	}
+
+	// One Newton step: e = f * V / Vnom (Q12), f = f * (2 - e).
+	int32_t u = (v * s_iFactor) >> 12;
+	int32_t e = (u * s_iNomRecip) >> 16;
+	int32_t f = ((int32_t) s_iFactor * (2 * CTL_ONE - e)) >> 12;
+	if(f > COMP_MAX) f = COMP_MAX;
+	if(f < CTL_ONE / 2) f = CTL_ONE / 2;
+	s_iFactor = (uint16_t) f;
+
+	int32_t d = ((int32_t) offset * s_iFactor + CTL_ONE / 2) >> 12;
+	if(d > CTL_MAXOFFSET)  d = CTL_MAXOFFSET;
+	if(d < -CTL_MAXOFFSET) d = -CTL_MAXOFFSET;
+	return (int16_t) d;
+}
+
+// --------------------------------------------------------
+// Control_IsCompOn()
+// Returns True if battery compensation is on.
+bool8 Control_IsCompOn()
+{
+	return s_bComp;
+}
+
+// --------------------------------------------------------
+// Control_GetCompFactor()
+// Returns the battery compensation factor, in Q12.
+uint16_t Control_GetCompFactor()
+{
+	return s_iFactor;
+}
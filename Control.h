@@ -0,0 +1,70 @@
+/*
+ * Control.h
+ *
+ * The control law that turns a commanded pulse width into the width
+ * actually sent to the PWM module, and the fault checks that run at
+ * the control rate.
+ *
+ * Created: 10/18/2026
+ */ 
+
+#ifndef CONTROL_H_
+#define CONTROL_H_
+
+#include "MainDef.h"
+
+#define CTL_NEUTRAL   1500     // Neutral pulse width, in usecs.
+#define CTL_MAXOFFSET 512      // Maximum offset from neutral, in usecs.
+#define CTL_ONE       4096     // A factor of 1.0 in the Q12 format used here.
+
+// Fault bits.  Once set, a fault stays set until cleared.
+#define CTL_FAULT_OVERCURRENT  0x01    // Current went over eeCurLimit.
+#define CTL_FAULT_ABORT        0x02    // Stopped by the operator.
+#define CTL_FAULT_STALL        0x04    // Motor stalled.
+#define CTL_FAULT_THERMAL      0x08    // Motor over its thermal trip level.  See Thermal.c.
+#define CTL_FAULT_SEQ          0x10    // The output did not reach neutral for the relay.  See Seq.c.
+
+// Stall actions.
+#define CTL_STALL_OFF       0   // No stall detection.
+#define CTL_STALL_THROTTLE  1   // Halve the output until the command returns to neutral.
+#define CTL_STALL_CUT       2   // Latch CTL_FAULT_STALL, and cut the output.
+
+// Reversal states.
+#define CTL_REV_NONE   0       // Not reversing.
+#define CTL_REV_DECEL  1       // Going to neutral.
+#define CTL_REV_DWELL  2       // Holding at neutral.
+
+EEi16(eeCurLimit, 6000);        // Overcurrent fault level, in 100th of Amps.
+
+// Stall detection settings.
+EEu8(eeStallAction, CTL_STALL_CUT);   // CTL_STALL_xxx.
+EEi16(eeStallAmps, 2000);       // Current above which the motor may be stalled, in 100th of Amps.
+EEi16(eeStallMinCmd, 100);      // Least width offset from neutral that counts as a command, in usecs.
+EEu16(eeStallTime, 1000);       // How long the stall must last, in msecs.
+
+EEu16(eeRevDwell, 500);         // Time held at neutral when reversing, in msecs.
+EEu16(eeCtlRate, 500);          // Fast control rate, per second.  0 = in the tick only.  See Control_Fast().
+
+// Battery sag compensation settings.
+EEu8(eeBattComp, 0);            // 1 = scale the width offset by nominal/measured battery voltage.
+EEu16(eeBattNominal, 12000);    // Nominal battery voltage, in mV.
+
+void Control_Setup();
+void Control_Drive(bool8 bOn, bool8 forward);
+void Control_SetCommand(int16_t offset);
+void Control_SetPotCommand(bool8 bOn);
+void Control_Reverse();
+bool8 Control_IsForward();
+uint8_t Control_GetRevState();
+int16_t Control_Output(int16_t offset);
+int16_t Control_Compensate(int16_t offset);
+bool8 Control_IsCompOn();
+uint16_t Control_GetCompFactor();
+void Control_SetFault(uint8_t fault);
+uint8_t Control_GetFault();
+void Control_ClearFault();
+uint32_t Control_GetStallTime();
+uint16_t Control_GetStallCost(bool8 bMax);
+bool8 Control_IsThrottled();
+
+#endif /* CONTROL_H_ */
@@ -0,0 +1,244 @@
+/*
+ * CurCtl.c
+ *
+ * Closed loop current (torque) control.  The pot commands a current,
+ * from zero to eeCurMax, and a PI loop finds the pulse width that
+ * gives it.  The loop runs from the ADC frame callback, every
+ * CC_DECIMATE frames, on the average of the fresh current samples from
+ * those frames.  So the loop rate is fixed by the ADC, not by how fast
+ * the UI loop spins.
+ *
+ * The pot goes through the same curve as in width mode (PotCurve.c), and
+ * the size of the shaped offset, out of CTL_MAXOFFSET, is the fraction of
+ * eeCurMax.  So the current is zero wherever the curve puts neutral (the
+ * middle of the pot, with the bipolar curve), which is where the run
+ * screen offers Run and Dir.  The direction is not taken from the pot;
+ * it is set with CurCtl_SetForward().
+ *
+ * Everything is in fixed point.  The error is in 100th of Amps, and the
+ * gains are in usecs of width offset per 0.01 Amp, in 1/256ths.  The
+ * integrator is kept in 1/256 usecs.  Anti-windup: the integrator is not
+ * advanced while the output is saturated in the direction of the error,
+ * and is itself clamped to the output range.  The output is a width
+ * offset from neutral, from zero to CTL_MAXOFFSET, with the sign given
+ * by the direction.  (The shunt can only see the magnitude of the
+ * current, so the loop never drives through neutral.)  That goes out
+ * through Control_Output(), so the stall throttle and the thermal derate
+ * cut the width a hot or stalled motor gets, whatever the loop asks
+ * for.  While they act, the integrator runs up to its clamp.
+ *
+ * The time spent in each tick is measured in CPU cycles, with
+ * PWM_GetCycles(), so it does not depend on the PWM protocol.
+ *
+ * The loop can be tuned without a motor in the host simulation,
+ * HostSim/CurCtlSim.c, which runs this file against a motor model.
+ *
+ * Created: 10/18/2026
+ */
+
+#include "MainDef.h"
+#include "ADC.h"
+#include "PWM.h"
+#include "Control.h"
+#include "PotCurve.h"
+#include "SysClock.h"
+#include "CurCtl.h"
+
+static volatile bool8 s_bRunning = False;   // True while the loop is in control.
+static bool8    s_bForward = True;          // Direction of the output.
+static int16_t  s_iKp = 0;                  // Gains, loaded from EEPROM.
+static int16_t  s_iKi = 0;
+static int16_t  s_iMax = 0;                 // Current at full pot.
+static int32_t  s_iInteg = 0;               // Integrator, in 1/256 usecs.
+static int32_t  s_iSum = 0;                 // Sum of the current samples since the last tick.
+static uint8_t  s_iDiv = 0;                 // ADC frames since the last tick.
+static volatile int16_t s_iSetpoint = 0;    // Last setpoint, in 100th of Amps.
+static volatile int16_t s_iMeasured = 0;    // Last measured current, in 100th of Amps.
+static volatile uint16_t s_iTickTime = 0;   // Time spent in the last tick, in CPU cycles.
+static volatile uint16_t s_iMaxTickTime = 0;// Most time spent in any tick, in CPU cycles.
+static volatile int16_t s_iFixedSetpoint = -1;  // If not negative, used instead of the pot.
+static uint8_t  *s_pStepBuf = NULL;         // Step test record, or NULL.
+static volatile uint8_t s_iStep = 0;        // Entries recorded in the step test.
+static uint32_t s_iStepScale = 0;           // Scale for the step test record, Q16.
+
+static void CurCtl_Tick();
+
+// --------------------------------------------------------
+// CurCtl_Setup()
+// Loads the gains and limits from EEPROM.
+void CurCtl_Setup()
+{
+	s_iKp = eeprom_read_word((uint16_t *) &eeCurKp);
+	s_iKi = eeprom_read_word((uint16_t *) &eeCurKi);
+	s_iMax = eeprom_read_word((uint16_t *) &eeCurMax);
+}
+
+// --------------------------------------------------------
+// CurCtl_Start()
+// Starts the current loop.  From here on, the loop owns the
+// PWM width until CurCtl_Stop() is called.
+void CurCtl_Start(bool8 forward)
+{
+	CurCtl_Setup();
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		s_bForward = forward;
+		s_iInteg = 0;
+		s_iSum = 0;
+		s_iDiv = 0;
+		s_iMaxTickTime = 0;
+		s_bRunning = True;
+	}
+	ADC_SetFrameCallback(CurCtl_Tick);
+}
+
+// --------------------------------------------------------
+// CurCtl_Stop()
+// Stops the loop, and returns the PWM to neutral.
+void CurCtl_Stop()
+{
+	ADC_SetFrameCallback(NULL);
+	s_bRunning = False;
+	PWM_SetWidth(CTL_NEUTRAL);
+}
+
+// --------------------------------------------------------
+// CurCtl_SetForward()
+// Sets the direction.  Only change it when the output is
+// near neutral.
+void CurCtl_SetForward(bool8 forward)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		s_bForward = forward;
+		s_iInteg = 0;
+	}
+}
+
+// --------------------------------------------------------
+// CurCtl_SetSetpoint()
+// Sets a fixed setpoint, in 100th of Amps, to be used instead
+// of the pot.  A negative value goes back to the pot.
+void CurCtl_SetSetpoint(int16_t setpoint)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		s_iFixedSetpoint = setpoint;
+	}
+}
+
+int16_t CurCtl_GetSetpoint()
+{
+	int16_t v;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { v = s_iSetpoint; }
+	return v;
+}
+
+int16_t CurCtl_GetMeasured()
+{
+	int16_t v;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { v = s_iMeasured; }
+	return v;
+}
+
+// Returns the time spent in the last tick, in CPU cycles.
+uint16_t CurCtl_GetTickTime()
+{
+	uint16_t v;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { v = s_iTickTime; }
+	return v;
+}
+
+// Returns the most time spent in any tick since the start, in CPU cycles.
+uint16_t CurCtl_GetMaxTickTime()
+{
+	uint16_t v;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { v = s_iMaxTickTime; }
+	return v;
+}
+
+// --------------------------------------------------------
+// CurCtl_StepTest()
+// Runs the loop from zero to a fixed setpoint (in 100th of
+// Amps), and records the measured current for CC_NSTEP ticks
+// into pBuf.  Each entry is scaled so that 64 is the setpoint.
+// Blocks until the record is full, a fault is latched (the tick
+// stops recording then), or CC_STEPTIMEOUT has gone by.  Returns
+// the number of entries recorded: less than CC_NSTEP if the test
+// was cut short.  The motor relay must be closed by the caller.
+uint8_t CurCtl_StepTest(int16_t setpoint, uint8_t *pBuf)
+{
+	if(setpoint <= 0) setpoint = 1;
+	s_iStepScale = ((64UL << 16) + setpoint / 2) / setpoint;
+	s_iStep = 0;
+	s_pStepBuf = pBuf;
+	CurCtl_SetSetpoint(setpoint);
+	CurCtl_Start(True);
+	uint32_t deadline = GetSystemTime() + CC_STEPTIMEOUT;
+	while(s_iStep < CC_NSTEP && !Control_GetFault() && (int32_t) (GetSystemTime() - deadline) < 0) ;
+	CurCtl_Stop();
+	CurCtl_SetSetpoint(-1);
+	s_pStepBuf = NULL;
+	return s_iStep;
+}
+
+// The control tick.  Called from the ADC interrupt at the end of
+// each frame.
+static void CurCtl_Tick()
+{
+	if(!s_bRunning) return;
+	if(Control_GetFault())
+	{
+		PWM_SetWidth(CTL_NEUTRAL);
+		return;
+	}
+	s_iSum += ADC_GetCurrent();
+	if(++s_iDiv < CC_DECIMATE) return;
+	s_iDiv = 0;
+
+	uint32_t t0 = PWM_GetCycles();
+	int16_t meas = s_iSum / CC_DECIMATE;
+	s_iSum = 0;
+	if(meas < 0) meas = 0;
+
+	int16_t sp = s_iFixedSetpoint;
+	if(sp < 0)
+	{
+		int16_t u = PotCurve_Shape(ADC_GetSensor(ADC_CH_POT));
+		if(u < 0) u = -u;
+		sp = ((int32_t) u * s_iMax) / CTL_MAXOFFSET;
+	}
+
+	int16_t err = sp - meas;
+	int32_t integ = s_iInteg + (int32_t) s_iKi * err;
+	int32_t out = ((int32_t) s_iKp * err + integ) >> 8;
+	if(out > CTL_MAXOFFSET)
+	{
+		out = CTL_MAXOFFSET;
+		if(err < 0) s_iInteg = integ;
+	}
+	else if(out < 0)
+	{
+		out = 0;
+		if(err > 0) s_iInteg = integ;
+	}
+	else s_iInteg = integ;
+	if(s_iInteg > ((int32_t) CTL_MAXOFFSET << 8)) s_iInteg = (int32_t) CTL_MAXOFFSET << 8;
+	if(s_iInteg < 0) s_iInteg = 0;
+
+	PWM_SetWidth(CTL_NEUTRAL + Control_Output(s_bForward ? out : -out));
+	s_iSetpoint = sp;
+	s_iMeasured = meas;
+
+	if(s_pStepBuf && s_iStep < CC_NSTEP)
+	{
+		// Past 4 times the setpoint, the entry is full scale, and the
+		// product would not fit.
+		uint16_t y = (meas >= 4 * sp) ? 255 : ((uint32_t) meas * s_iStepScale + 0x8000) >> 16;
+		s_pStepBuf[s_iStep++] = (y > 255) ? 255 : y;
+	}
+
+	uint16_t dt = PWM_GetCycles() - t0;
+	s_iTickTime = dt;
+	if(dt > s_iMaxTickTime) s_iMaxTickTime = dt;
+}
@@ -0,0 +1,35 @@
+/*
+ * CurCtl.h
+ *
+ * Closed loop current (torque) control.
+ *
+ * Created: 10/18/2026
+ */ 
+
+#ifndef CURCTL_H_
+#define CURCTL_H_
+
+#include "MainDef.h"
+
+#define CC_DECIMATE   4        // ADC frames per control tick.  About 350 Hz.
+#define CC_NSTEP      96       // Number of ticks recorded by the step test.
+#define CC_STEPTIMEOUT 2000    // Longest the step test may take, in msecs.  The record takes about 280.
+
+// Control settings.
+EEu8(eeCtlMode, 0);             // 0 = pot commands pulse width, 1 = pot commands current.
+EEi16(eeCurKp, 26);             // Proportional gain, usecs per 0.01 Amp, in 1/256ths.
+EEi16(eeCurKi, 4);              // Integral gain, usecs per 0.01 Amp per tick, in 1/256ths.
+EEi16(eeCurMax, 2000);          // Current at full pot, in 100th of Amps.
+
+void CurCtl_Setup();
+void CurCtl_Start(bool8 forward);
+void CurCtl_Stop();
+void CurCtl_SetForward(bool8 forward);
+void CurCtl_SetSetpoint(int16_t setpoint);
+int16_t CurCtl_GetSetpoint();
+int16_t CurCtl_GetMeasured();
+uint16_t CurCtl_GetTickTime();
+uint16_t CurCtl_GetMaxTickTime();
+uint8_t CurCtl_StepTest(int16_t setpoint, uint8_t *pBuf);
+
+#endif /* CURCTL_H_ */
@@ -0,0 +1,126 @@
+/*
+ * Dyno.c
+ *
+ * Dynamometer.  The motor turns against a brake, and the reaction on an
+ * arm presses on a load cell, read by HX711.c.  With the load cell
+ * reading less its zero (the tare), and eeDynoScale:
+ *
+ *     torque (mN.m)      = (reading - tare) * eeDynoScale / 65536
+ *     mechanical (0.1W)  = torque * RPM * 2 pi / 60 / 100
+ *     electrical (0.1W)  = mV * (100th of Amps) / 10000
+ *     efficiency (0.1%)  = 1000 * mechanical / electrical
+ *
+ * The speed is from the tach (Tach.c), so one must be set up.  The
+ * torque is worked out in Dyno_Poll(), in the main loop, as each reading
+ * comes in (10 per second), and averaged with a shift-2 IIR, as the
+ * readings are noisy.  Zeroing averages the next DYN_NZERO readings, so
+ * the caller must hold the motor stopped until Dyno_IsZeroing() is
+ * False, from Dyno_Start() and from Dyno_Zero().
+ *
+ * Created: 10/18/2026
+ */
+
+#include "MainDef.h"
+#include "ADC.h"
+#include "Tach.h"
+#include "HX711.h"
+#include "Dyno.h"
+
+#define DYN_NZERO      8                // Readings averaged for the zero.
+#define DYN_SHIFT      2                // Torque average: shift-2 IIR.
+#define DYN_PDIV       ((int32_t) (6000 / 6.283185307179586 + 0.5))   // Torque * RPM per 10th of a Watt.
+
+static int16_t s_iScale = 0;
+static int32_t s_iTare = 0;             // Zero reading.
+static uint16_t s_iLastCount = 0;       // Count of the last reading used.
+static int32_t s_iZeroSum = 0;
+static uint8_t s_nZero = 0;             // Readings still to take for the zero.
+static int32_t s_iTorque = 0;           // Average torque, in 1/16 mN.m.
+static bool8 s_bTorque = False;         // True once there is a torque.
+
+// --------------------------------------------------------
+// Dyno_Start()
+// Loads the settings, starts the load cell, and zeros it.
+// Returns False if the load cell pins are taken, or there is
+// no scheduler timer free for it.
+bool8 Dyno_Start()
+{
+	if(!HX711_Start()) return False;
+	s_iScale = eeprom_read_word((uint16_t *) &eeDynoScale);
+	s_iLastCount = HX711_GetCount();
+	s_bTorque = False;
+	s_iTorque = 0;
+	Dyno_Zero();
+	return True;
+}
+
+// Stops the load cell.
+void Dyno_Stop()
+{
+	HX711_Stop();
+}
+
+// Starts zeroing the load cell, over the next DYN_NZERO readings.
+void Dyno_Zero()
+{
+	s_iZeroSum = 0;
+	s_nZero = DYN_NZERO;
+}
+
+// Returns True until zeroing is done.
+bool8 Dyno_IsZeroing()
+{
+	return s_nZero != 0;
+}
+
+// --------------------------------------------------------
+// Dyno_Poll()
+// Takes in the new load cell reading, if there is one.  Call
+// from the main loop at least 10 times a second.
+void Dyno_Poll()
+{
+	uint16_t count = HX711_GetCount();
+	if(count == s_iLastCount) return;
+	s_iLastCount = count;
+	int32_t raw = HX711_GetRaw();
+	if(s_nZero)
+	{
+		s_iZeroSum += raw;
+		if(--s_nZero == 0)
+		{
+			s_iTare = s_iZeroSum / DYN_NZERO;
+			s_bTorque = False;
+		}
+		return;
+	}
+	// (raw - tare) * scale doesn't fit in 32 bits, so the reading is
+	// split in two, high 16 bits and low 8 bits, and each is scaled.
+	int32_t d = raw - s_iTare;
+	if(d > 0xFFFFFF) d = 0xFFFFFF;
+	if(d < -0xFFFFFF) d = -0xFFFFFF;
+	int32_t t = (((d >> 8) * s_iScale) >> 4) + (((d & 255) * s_iScale) >> 12);   // In 1/16 mN.m.
+	if(!s_bTorque) s_iTorque = t;
+	else s_iTorque += (t - s_iTorque) >> DYN_SHIFT;
+	s_bTorque = True;
+}
+
+// --------------------------------------------------------
+// Dyno_GetReadings()
+// Works out the torque, the powers and the efficiency, from the
+// load cell and the latest voltage, current and speed.
+void Dyno_GetReadings(DynoReadings *pReadings)
+{
+	int32_t torque = s_bTorque ? s_iTorque >> 4 : 0;
+	if(torque > 32767) torque = 32767;
+	if(torque < -32768) torque = -32768;
+	int16_t rpm = Tach_GetRpm();
+	int32_t elec = ((int32_t) ADC_GetBatteryVoltage() * ADC_GetCurrent()) / 10000;
+	int32_t mech = (torque * rpm) / DYN_PDIV;
+	if(mech > 32767) mech = 32767;
+	if(mech < -32768) mech = -32768;
+	pReadings->Torque = torque;
+	pReadings->Rpm = rpm;
+	pReadings->ElecW = elec;
+	pReadings->MechW = mech;
+	pReadings->Eff = (elec > 0) ? (int16_t) ((mech * 1000) / elec) : -1;
+}
@@ -0,0 +1,33 @@
+/*
+ * Dyno.h
+ *
+ * Dynamometer: torque from a load cell on an arm, and from it and the
+ * speed, voltage and current, the mechanical power and the efficiency.
+ *
+ * Created: 10/18/2026
+ */
+
+#ifndef DYNO_H_
+#define DYNO_H_
+
+#include "MainDef.h"
+
+EEi16(eeDynoScale, 1000);       // Torque per 65536 load cell counts, in mN.m.  Negative if mounted backward.
+
+typedef struct
+{
+	int16_t Torque;             // In mN.m.
+	int16_t Rpm;                // From the tach.
+	int16_t ElecW;              // Power from the battery, in 10th of Watts.
+	int16_t MechW;              // Power at the shaft, in 10th of Watts.
+	int16_t Eff;                // MechW / ElecW, in 10th of a percent.  -1 if there is no power in.
+} DynoReadings;
+
+bool8 Dyno_Start();
+void Dyno_Stop();
+void Dyno_Poll();
+void Dyno_Zero();
+bool8 Dyno_IsZeroing();
+void Dyno_GetReadings(DynoReadings *pReadings);
+
+#endif /* DYNO_H_ */
@@ -0,0 +1,397 @@
+/*
+ * Endurance.c
+ *
+ * Endurance (burn-in) test, for life testing a motor unattended.  Each
+ * cycle starts the motor at eeEndOffset from neutral, runs it for
+ * eeEndRun, stops it (through the ramp, back to neutral), and leaves it
+ * stopped for eeEndOff.  This repeats for eeEndCycles cycles, or until
+ * stopped, or until there is a fault.  The offset goes through
+ * Control_Output() every frame of the run, so the stall throttle, the
+ * thermal derate and the battery correction apply, and the width follows
+ * the derate as the motor heats.
+ *
+ * Like the sweep, the cycles run from the ADC frame callback, so the
+ * timing holds whatever the UI is doing.  From the start of each cycle
+ * until the output is back at neutral, every frame adds to:
+ *
+ *     Peak current, and the sum of the current for the mean.
+ *     Energy: the sum of V * I, in mV * 100th of Amps, >> 16, with the
+ *             bits shifted out carried to the next frame, so none are
+ *             lost.  One count is 65536e-5 / ADC_FRAMERATE Joules, so 32
+ *             bits last for hours at full current.
+ *     Time to steady state: two running averages of the current, one
+ *             fast (shift 3) and one slow (shift 7).  Once the ramp has
+ *             reached the width (PWM_GetSettledCycles(), as the width
+ *             itself can move a little from frame to frame), the current
+ *             is steady when they agree to within 1/16 for END_SSFRAMES
+ *             frames in a row.  The time is
+ *             from the start of the cycle to the start of that stretch.
+ *             If the current never settles, it is the whole run.
+ *
+ * At the end of each cycle the sums and frame counts are handed to the
+ * main loop, and Endurance_Poll() turns them into the results and adds
+ * them to the statistics across the cycles, so the long divisions stay
+ * out of the interrupt.  The time to steady state is held to 32767ms,
+ * and the run time to END_MAXRUN.  For each measurement, the
+ * min and max, and Welford's running mean and variance:
+ *
+ *     mean += (x - mean) / n
+ *     var  += ((x - old mean) * (x - new mean) - var) / n
+ *
+ * The mean is kept with 8 fraction bits, and the variance with 8 (the
+ * differences with 4 each), so the memory is the same for any number of
+ * cycles, and small spreads are not lost to rounding.  Differences of
+ * more than 4095 saturate, as does the count, at 65535 cycles.
+ *
+ * Created: 10/18/2026
+ */
+
+#include "MainDef.h"
+#include "ADC.h"
+#include "PWM.h"
+#include "Control.h"
+#include "Endurance.h"
+
+// Phases of a cycle.
+#define PH_RUN       0          // Running at the offset.
+#define PH_STOP      1          // Waiting for the output to get back to neutral.
+#define PH_OFF       2          // Stopped between cycles.
+
+#define END_FASTSHIFT  3        // Running averages for the steady state.
+#define END_SLOWSHIFT  7
+#define END_SSFRAMES   ((uint16_t) (ADC_FRAMERATE / 4))    // Steady for 0.25s.
+#define END_EDIV       ((int32_t) (ADC_FRAMERATE / 6.5536 + 0.5))   // Energy counts per 10th of a Joule.
+#define END_MAXRUN     30000    // Longest run time, in msecs.
+
+typedef struct
+{
+	int16_t Min;
+	int16_t Max;
+	int32_t MeanQ8;            // Mean, with 8 fraction bits.
+	uint32_t VarQ8;            // Variance, with 8 fraction bits.
+} EndAcc;
+
+typedef struct
+{
+	int16_t Peak;
+	int32_t SumAmps;
+	int32_t SumPower;
+	uint16_t Frames;           // Frames in the cycle.
+	uint16_t Tss;              // Frames to steady state.
+} EndSums;
+
+// Settings, loaded at the start.
+static int16_t  s_iOffset = 0;
+static uint16_t s_nRun = 0;              // Run time, in ADC frames.
+static uint16_t s_nOff = 0;              // Off time, in ADC frames.
+static uint16_t s_nCycles = 0;           // Cycles to run.  0 = no limit.
+static uint16_t s_iTarget = 0;           // Width while running, in 1/16 usecs.
+static uint32_t s_tRun = 0;              // Time the run's width was set, in CPU cycles.
+
+// Used by the frame callback.
+static volatile uint8_t s_iState = END_IDLE;
+static volatile uint16_t s_iCycle = 0;   // Cycles finished.
+static uint8_t  s_iPhase = PH_RUN;
+static uint16_t s_iCount = 0;            // Frames left in this phase.
+static uint16_t s_iFrames = 0;           // Frames since the start of the cycle.
+static int16_t  s_iPeak = 0;
+static int32_t  s_iSumAmps = 0;
+static int32_t  s_iSumPower = 0;
+static int32_t  s_iPowerFrac = 0;        // Bits of the power sum shifted out.
+static int32_t  s_iFast = 0;             // Running averages of the current, in 1/16 100th of Amps.
+static int32_t  s_iSlow = 0;
+static uint16_t s_iSteady = 0;           // Frames the averages have agreed for.
+static uint16_t s_iTss = 0;              // Frames to steady state.
+static bool8    s_bTss = False;          // True once the current is steady.
+
+// Sums of the last cycle, passed to Endurance_Poll().
+static volatile bool8 s_bReady = False;
+static EndSums s_Last;
+
+// Statistics across the cycles.
+static uint16_t s_nStats = 0;
+static EndAcc s_Acc[END_NMETRICS];
+static int16_t s_Prev[END_NMETRICS];     // The last cycle added.
+
+static void Endurance_Frame();
+static void StartCycle();
+static void EndCycle();
+static void Finish(uint8_t state);
+static void RunOutput();
+static void AddStat(EndAcc *pA, int16_t x);
+static uint16_t ISqrt(uint32_t v);
+
+// --------------------------------------------------------
+// Endurance_Start()
+// Starts an endurance test with the settings in EEPROM.  The
+// motor relay must already be closed.  Returns False if there
+// is a fault.
+bool8 Endurance_Start()
+{
+	if(Control_GetFault()) return False;
+	Endurance_Stop();
+	s_iOffset = eeprom_read_word((uint16_t *) &eeEndOffset);
+	uint16_t run = eeprom_read_word(&eeEndRun);
+	if(run > END_MAXRUN) run = END_MAXRUN;
+	s_nRun = ((uint32_t) run * ADC_FRAMERATE) / 1000;
+	s_nOff = ((uint32_t) eeprom_read_word(&eeEndOff) * ADC_FRAMERATE) / 1000;
+	s_nCycles = eeprom_read_word(&eeEndCycles);
+	if(s_nRun == 0) s_nRun = 1;
+	s_nStats = 0;
+	for(uint8_t i = 0; i < END_NMETRICS; i++) s_Prev[i] = 0;
+	s_bReady = False;
+	s_iCycle = 0;
+	StartCycle();
+	s_iState = END_RUNNING;
+	ADC_SetFrameCallback(Endurance_Frame);
+	return True;
+}
+
+// --------------------------------------------------------
+// Endurance_Stop()
+// Stops the test, and returns the output to neutral.  A cycle
+// not finished is not counted.
+void Endurance_Stop()
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		if(s_iState == END_RUNNING) Finish(END_ABORTED);
+	}
+}
+
+// Called from the ADC interrupt at the end of each frame.
+static void Endurance_Frame()
+{
+	if(s_iState != END_RUNNING) return;
+	if(Control_GetFault())
+	{
+		Finish(END_ABORTED);
+		return;
+	}
+	if(s_iPhase == PH_OFF)
+	{
+		if(s_iCount > 0)
+		{
+			s_iCount--;
+			return;
+		}
+		StartCycle();
+	}
+
+	int16_t amps = ADC_GetCurrent();
+	if(amps > s_iPeak) s_iPeak = amps;
+	s_iSumAmps += amps;
+	s_iPowerFrac += (int32_t) ADC_GetBatteryVoltage() * amps;
+	s_iSumPower += s_iPowerFrac >> 16;
+	s_iPowerFrac &= 0xFFFF;
+	if(s_iFrames < 65535) s_iFrames++;
+
+	if(s_iPhase == PH_RUN)
+	{
+		int32_t x = (int32_t) amps << 4;
+		s_iFast += (x - s_iFast) >> END_FASTSHIFT;
+		s_iSlow += (x - s_iSlow) >> END_SLOWSHIFT;
+		if(!s_bTss)
+		{
+			int32_t d = s_iFast - s_iSlow;
+			int32_t tol = s_iSlow >> 4;
+			if(d < 0) d = -d;
+			if(tol < 0) tol = -tol;
+			if((int32_t) (PWM_GetSettledCycles() - s_tRun) > 0 && d <= tol)
+			{
+				if(++s_iSteady >= END_SSFRAMES)
+				{
+					s_iTss = s_iFrames - END_SSFRAMES;
+					s_bTss = True;
+				}
+			}
+			else s_iSteady = 0;
+		}
+		if(--s_iCount > 0)
+		{
+			RunOutput();
+			return;
+		}
+		s_iPhase = PH_STOP;
+		PWM_SetWidth(CTL_NEUTRAL);
+		return;
+	}
+
+	// PH_STOP.
+	if(PWM_GetWidth() != CTL_NEUTRAL) return;
+	EndCycle();
+	if(s_nCycles != 0 && s_iCycle >= s_nCycles)
+	{
+		Finish(END_DONE);
+		return;
+	}
+	s_iPhase = PH_OFF;
+	s_iCount = s_nOff;
+}
+
+// Clears the sums, and starts the motor.
+static void StartCycle()
+{
+	s_iPhase = PH_RUN;
+	s_iCount = s_nRun;
+	s_iFrames = 0;
+	s_iPeak = 0;
+	s_iSumAmps = 0;
+	s_iSumPower = 0;
+	s_iPowerFrac = 0;
+	s_iFast = 0;
+	s_iSlow = 0;
+	s_iSteady = 0;
+	s_bTss = False;
+	s_iTarget = 0;
+	RunOutput();
+	s_tRun = PWM_GetCycles();
+}
+
+// Sets the width for the run from the offset, through Control_Output().
+// Only sent to the PWM when it changes.
+static void RunOutput()
+{
+	uint16_t target = (uint16_t) (CTL_NEUTRAL + Control_Output(s_iOffset)) << 4;
+	if(target == s_iTarget) return;
+	s_iTarget = target;
+	PWM_SetWidth(target >> 4);
+}
+
+// Hands the sums of the cycle just finished to Endurance_Poll().
+static void EndCycle()
+{
+	s_Last.Peak = s_iPeak;
+	s_Last.SumAmps = s_iSumAmps;
+	s_Last.SumPower = s_iSumPower;
+	s_Last.Frames = s_iFrames;
+	s_Last.Tss = s_bTss ? s_iTss : s_nRun;
+	s_bReady = True;
+	s_iCycle++;
+}
+
+// Ends the test, and returns the output to neutral.
+static void Finish(uint8_t state)
+{
+	ADC_SetFrameCallback(NULL);
+	PWM_SetWidth(CTL_NEUTRAL);
+	s_iState = state;
+}
+
+// --------------------------------------------------------
+// Endurance_Poll()
+// Adds the last cycle, if there is a new one, to the statistics.
+// Call from the main loop, at least once per cycle, and once
+// more after the test ends.
+void Endurance_Poll()
+{
+	EndSums sums;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		if(!s_bReady) return;
+		sums = s_Last;
+		s_bReady = False;
+	}
+	int32_t e = sums.SumPower / END_EDIV;
+	if(e > 32767) e = 32767;
+	if(e < -32768) e = -32768;
+	uint32_t tss = ((uint32_t) sums.Tss * 1000) / ADC_FRAMERATE;
+	if(tss > 32767) tss = 32767;
+	int16_t last[END_NMETRICS];
+	last[END_PEAK] = sums.Peak;
+	last[END_MEAN] = sums.SumAmps / sums.Frames;
+	last[END_ENERGY] = e;
+	last[END_TSS] = tss;
+	if(s_nStats < 65535) s_nStats++;
+	for(uint8_t i = 0; i < END_NMETRICS; i++)
+	{
+		AddStat(&s_Acc[i], last[i]);
+		s_Prev[i] = last[i];
+	}
+}
+
+// Adds a value to the statistics of one measurement.  s_nStats
+// already counts it.
+static void AddStat(EndAcc *pA, int16_t x)
+{
+	int32_t xQ8 = (int32_t) x << 8;
+	if(s_nStats == 1)
+	{
+		pA->Min = x;
+		pA->Max = x;
+		pA->MeanQ8 = xQ8;
+		pA->VarQ8 = 0;
+		return;
+	}
+	if(x < pA->Min) pA->Min = x;
+	if(x > pA->Max) pA->Max = x;
+	int32_t d1 = (xQ8 - pA->MeanQ8) >> 4;          // With 4 fraction bits.
+	pA->MeanQ8 += (xQ8 - pA->MeanQ8) / s_nStats;
+	int32_t d2 = (xQ8 - pA->MeanQ8) >> 4;
+	// d1 and d2 have the same sign, so the product is never negative.
+	if(d1 < 0) { d1 = -d1; d2 = -d2; }
+	if(d2 < 0) d2 = 0;
+	uint32_t p = (d1 > 65535 || d2 > 65535) ? 0xFFFFFFFF : (uint32_t) d1 * (uint32_t) d2;
+	if(p >= pA->VarQ8) pA->VarQ8 += (p - pA->VarQ8) / s_nStats;
+	else pA->VarQ8 -= (pA->VarQ8 - p) / s_nStats;
+}
+
+// Returns the integer square root of v.
+static uint16_t ISqrt(uint32_t v)
+{
+	uint16_t r = 0;
+	for(uint16_t bit = 0x8000; bit != 0; bit >>= 1)
+	{
+		uint16_t t = r | bit;
+		if((uint32_t) t * t <= v) r = t;
+	}
+	return r;
+}
+
+// --------------------------------------------------------
+// Endurance_GetState()
+// Returns END_IDLE, END_RUNNING, END_DONE or END_ABORTED.
+uint8_t Endurance_GetState()
+{
+	return s_iState;
+}
+
+// Returns True while a test is running.
+bool8 Endurance_IsRunning()
+{
+	return s_iState == END_RUNNING;
+}
+
+// Returns the number of cycles finished.
+uint16_t Endurance_GetCycles()
+{
+	uint16_t v;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { v = s_iCycle; }
+	return v;
+}
+
+// Returns a measurement (END_xxx) of the last cycle added to the
+// statistics.
+int16_t Endurance_GetLast(uint8_t iMetric)
+{
+	return s_Prev[iMetric];
+}
+
+// Copies out the statistics of a measurement (END_xxx) across the
+// cycles so far.  All zero before the first cycle.
+void Endurance_GetStats(uint8_t iMetric, EndStats *pStats)
+{
+	if(s_nStats == 0)
+	{
+		pStats->Min = 0;
+		pStats->Max = 0;
+		pStats->Mean = 0;
+		pStats->StdDev = 0;
+		return;
+	}
+	EndAcc *pA = &s_Acc[iMetric];
+	pStats->Min = pA->Min;
+	pStats->Max = pA->Max;
+	pStats->Mean = (pA->MeanQ8 + 128) >> 8;
+	pStats->StdDev = (ISqrt(pA->VarQ8) + 8) >> 4;
+}
@@ -0,0 +1,50 @@
+/*
+ * Endurance.h
+ *
+ * Endurance (burn-in) test: repeated start-run-stop cycles, with
+ * statistics for each cycle and across all of them.
+ *
+ * Created: 10/18/2026
+ */
+
+#ifndef ENDURANCE_H_
+#define ENDURANCE_H_
+
+#include "MainDef.h"
+
+// Per-cycle measurements.
+#define END_PEAK     0         // Peak current, in 100th of Amps.
+#define END_MEAN     1         // Mean current, in 100th of Amps.
+#define END_ENERGY   2         // Energy from the battery, in 10ths of a Joule.
+#define END_TSS      3         // Time from the start to a steady current, in msecs.
+#define END_NMETRICS 4
+
+// Endurance states.
+#define END_IDLE     0
+#define END_RUNNING  1
+#define END_DONE     2
+#define END_ABORTED  3
+
+EEi16(eeEndOffset, 200);        // Width offset from neutral while running, in usecs.
+EEu16(eeEndRun, 3000);          // Run time of each cycle, in msecs.
+EEu16(eeEndOff, 2000);          // Time stopped between cycles, in msecs.
+EEu16(eeEndCycles, 1000);       // Cycles to run.  0 = until stopped.
+
+typedef struct
+{
+	int16_t Min;               // Across all the cycles so far.
+	int16_t Max;
+	int16_t Mean;
+	uint16_t StdDev;
+} EndStats;
+
+bool8 Endurance_Start();
+void Endurance_Stop();
+void Endurance_Poll();
+uint8_t Endurance_GetState();
+bool8 Endurance_IsRunning();
+uint16_t Endurance_GetCycles();
+int16_t Endurance_GetLast(uint8_t iMetric);
+void Endurance_GetStats(uint8_t iMetric, EndStats *pStats);
+
+#endif /* ENDURANCE_H_ */
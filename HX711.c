@@ -0,0 +1,172 @@
+/*
+ * HX711.c
+ *
+ * Driver for an HX711 load cell amplifier, on channel A at a gain of 128.
+ * The HX711 has a two wire interface: it pulls DOUT low when a reading is
+ * ready, and then each pulse on PD_SCK shifts out one bit, MSB first, 24
+ * bits in all, in two's complement.  One more pulse picks channel A and
+ * a gain of 128 for the next reading.  PD_SCK must not stay high for more
+ * than 60us, or the chip powers down, but it can stay low for as long as
+ * we like between pulses.
+ *
+ * So rather than clock out all 24 bits in one go, HX711_Tick() clocks out
+ * HX_BURST bits at a time, which takes about 20us.  It runs from a
+ * SCHED_ISR timer (Sched.c) every HX_TICKMS, in the system clock tick,
+ * started and stopped with the load cell, and not from the PWM tick,
+ * which at the fast PWM rates has to fit in the PWM period.  A SCHED_ISR
+ * callback runs with interrupts off, so no ISR can stretch a pulse, and
+ * the burst is counted in the scheduler's worst tick cost
+ * (Sched_GetStats()).  The tick that sees DOUT low clocks out the first
+ * burst, so a reading takes 24 / HX_BURST ticks (60ms) in all, and is in
+ * at most that long after DOUT goes low, counting the wait for the tick.
+ * That is well inside the 100ms between readings at 10 samples per
+ * second (RATE pin low).  At 80 samples per second, HX_BURST must be
+ * raised to 24, for all the bits in one tick, and a reading is then taken
+ * each tick, with the ones made in between lost.  Each pulse is also in
+ * an atomic block of its own, so it stays short however the tick is
+ * called.
+ *
+ * The pins are shared with Servo2 channels 1 and 2, so the HX711 can't be
+ * started while Servo2 is on (eeServo2Chans not zero).
+ *
+ * The driver can be checked without a load cell in the host simulation,
+ * HostSim/HX711Sim.c, which runs this file against a model of the chip
+ * on the pins.
+ *
+ * Created: 10/18/2026
+ */
+
+#include "MainDef.h"
+#include "Servo2.h"
+#include "Sched.h"
+#include "HX711.h"
+
+#define HxSckPin       BSpare1          // HX711 PD_SCK (output).
+#define HxDoutPin      BSpare2          // HX711 DOUT (input).
+
+#define HX_BITS        24               // Data bits per reading.
+#define HX_GAINPULSES  1                // Extra pulses after the data: channel A, gain 128.
+#define HX_BURST       8                // Bits clocked out per tick.
+#define HX_TICKMS      20               // Time between ticks, in msecs: one system clock tick.
+
+// States.
+#define HX_OFF         0
+#define HX_WAIT        1                // Waiting for DOUT to go low.
+#define HX_READ        2                // Clocking out a reading.
+
+static volatile uint8_t s_iState = HX_OFF;
+static uint8_t s_iBit = 0;              // Bits clocked out of this reading.
+static uint32_t s_iShift = 0;           // The bits so far.
+static volatile int32_t s_iRaw = 0;     // Last reading.
+static volatile uint16_t s_iCount = 0;  // Readings so far.
+
+static uint8_t s_iTimer = SCHED_NONE;   // The tick's timer.
+
+static void HX711_Tick();
+static uint8_t Pulse();
+
+// --------------------------------------------------------
+// HX711_Start()
+// Sets up the pins and starts reading.  Returns False if the
+// pins are taken by Servo2, or there is no scheduler timer free.
+bool8 HX711_Start()
+{
+	if(Servo2_GetChannels() != 0) return False;
+	if(s_iTimer == SCHED_NONE) s_iTimer = Sched_Add(HX711_Tick, HX_TICKMS, HX_TICKMS, SCHED_ISR);
+	if(s_iTimer == SCHED_NONE) return False;
+	BitOff(PORTB, HxSckPin);
+	BitOn(DDRB, HxSckPin);
+	BitOff(DDRB, HxDoutPin);
+	BitOn(PORTB, HxDoutPin);
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		s_iCount = 0;
+		s_iRaw = 0;
+		s_iState = HX_WAIT;
+	}
+	return True;
+}
+
+// Stops reading, and leaves the pins as plain inputs.  If the
+// clock floats high, the HX711 powers down, and wakes up again
+// when it is next started.
+void HX711_Stop()
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		s_iState = HX_OFF;
+	}
+	if(s_iTimer != SCHED_NONE)
+	{
+		Sched_Cancel(s_iTimer);
+		s_iTimer = SCHED_NONE;
+	}
+	BitOff(DDRB, HxSckPin);
+	BitOff(PORTB, HxDoutPin);
+}
+
+// --------------------------------------------------------
+// HX711_Tick()
+// Clocks out the next HX_BURST bits of a reading, if there is one.
+// Runs every HX_TICKMS, from the scheduler, in the system clock
+// tick interrupt.
+static void HX711_Tick()
+{
+	if(s_iState == HX_OFF) return;
+	if(s_iState == HX_WAIT)
+	{
+		if(BitTest(PINB, HxDoutPin)) return;     // Not ready.  DOUT goes low when it is.
+		s_iBit = 0;
+		s_iShift = 0;
+		s_iState = HX_READ;
+	}
+	uint8_t n = HX_BITS - s_iBit;
+	if(n > HX_BURST) n = HX_BURST;
+	s_iBit += n;
+	while(n--) s_iShift = (s_iShift << 1) | Pulse();
+	if(s_iBit < HX_BITS) return;
+
+	for(uint8_t i = 0; i < HX_GAINPULSES; i++) Pulse();
+	if(s_iShift & 0x800000) s_iShift |= 0xFF000000;    // Sign extend.
+	s_iRaw = (int32_t) s_iShift;
+	s_iCount++;
+	s_iState = HX_WAIT;
+}
+
+// Clocks one bit out of the HX711, and returns it.  The pulse is
+// about 1us high.
+static uint8_t Pulse()
+{
+	uint8_t b;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		BitOn(PORTB, HxSckPin);
+		_delay_us(1);
+		b = BitTest(PINB, HxDoutPin) ? 1 : 0;
+		BitOff(PORTB, HxSckPin);
+	}
+	_delay_us(1);
+	return b;
+}
+
+// Returns True while the HX711 is being read.
+bool8 HX711_IsOn()
+{
+	return s_iState != HX_OFF;
+}
+
+// Returns the last reading, in counts, signed.
+int32_t HX711_GetRaw()
+{
+	int32_t v;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { v = s_iRaw; }
+	return v;
+}
+
+// Returns the number of readings so far.  Wraps.
+uint16_t HX711_GetCount()
+{
+	uint16_t v;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { v = s_iCount; }
+	return v;
+}
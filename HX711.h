@@ -0,0 +1,21 @@
+/*
+ * HX711.h
+ *
+ * Load cell input, from an HX711 amplifier on the spare BSpare1 (clock)
+ * and BSpare2 (data) pins.
+ *
+ * Created: 10/18/2026
+ */
+
+#ifndef HX711_H_
+#define HX711_H_
+
+#include "MainDef.h"
+
+bool8 HX711_Start();
+void HX711_Stop();
+bool8 HX711_IsOn();
+int32_t HX711_GetRaw();
+uint16_t HX711_GetCount();
+
+#endif /* HX711_H_ */
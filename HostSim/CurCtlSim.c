@@ -0,0 +1,125 @@
+/*
+ * CurCtlSim.c
+ *
+ * Host simulation of the current loop in CurCtl.c, for tuning the gains
+ * without a motor.  The real CurCtl.c is built in, and the ADC, PWM and
+ * clock are replaced with a model of a locked-rotor motor (R = 0.1 ohm)
+ * behind an ESC with a lag of about 4 ticks, driven from the width the
+ * loop sets.  The model's current is quantized to the shunt's 0.25 Amp
+ * steps.
+ *
+ * The step test is run as is: each time CurCtl_StepTest() reads the
+ * clock while it waits, one ADC frame goes by and the frame callback
+ * runs.  It prints the record, the rise time, the overshoot and the
+ * error at the end, and then runs the test again with a fault latched
+ * part way, to check that it is cut short.  With the default gains, at
+ * 10A: 90% in 3 ticks, no overshoot, a dip to 58 (of 64) at tick 5 as
+ * the ESC lag catches up, and within one count from tick 21.
+ *
+ * It also times the loop.  PWM_GetCycles() here counts host time, in
+ * 0.1us (one cycle at 10MHz), so the loop's own tick timer
+ * (CurCtl_GetTickTime()) measures the PI tick on the host, and each
+ * frame callback is timed with clock_gettime() as well.  Both are host
+ * times, which say only that the tick is short and bounded, not what
+ * it costs on the AVR: the firmware shows that, in CPU cycles, on the
+ * step test screen.
+ *
+ * Build and run, from this directory:
+ *
+ *     gcc -std=gnu99 -Wall -I. -o CurCtlSim CurCtlSim.c && ./CurCtlSim
+ *
+ * Created: 10/18/2026
+ */
+
+#define MainFile
+#include <stdio.h>
+#include <time.h>
+#include "../CurCtl.c"
+
+#define SIM_VBATT   12000       // Battery, in mV.
+
+static void (*s_pFrame)() = NULL;
+static uint32_t s_nFrames = 0;
+static uint16_t s_iWidth = CTL_NEUTRAL;
+static int16_t  s_iModel = 0;           // Model current, in 100th of Amps.
+static uint32_t s_iFaultAt = 0;         // Frame at which to latch a fault.  0 = never.
+
+void ADC_SetFrameCallback(void (*pCallback)()) { s_pFrame = pCallback; }
+int16_t ADC_GetSensor(uint8_t iChan) { return 0; }
+int16_t PotCurve_Shape(uint16_t pot) { return 0; }       // The step test has a fixed setpoint.
+void PWM_SetWidth(uint16_t width) { s_iWidth = width; }
+static uint64_t s_iFrameNs = 0;         // Host time in the frame callbacks, in nsecs.
+static uint64_t s_iFrameMaxNs = 0;
+
+static uint64_t HostNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+uint32_t PWM_GetCycles() { return (uint32_t) (HostNs() / 100); }
+int16_t Control_Output(int16_t offset) { return Control_GetFault() ? 0 : offset; }   // No derate in the model.
+uint8_t Control_GetFault() { return (s_iFaultAt && s_nFrames >= s_iFaultAt) ? CTL_FAULT_OVERCURRENT : 0; }
+
+// Motor-and-shunt model, one ADC frame.  With R = 0.1 ohm, the steady
+// state current in 100th of Amps is just the applied voltage in mV.
+int16_t ADC_GetCurrent()
+{
+	int16_t u = (int16_t) s_iWidth - CTL_NEUTRAL;
+	if(u < 0) u = -u;
+	int16_t v = ((int32_t) SIM_VBATT * u) >> 9;
+	s_iModel += (v - s_iModel) >> 4;        // Lag of 16 frames, or 4 ticks.
+	return (s_iModel / 25) * 25;            // Shunt resolution.
+}
+
+// The step test waits on the clock, so each read is one ADC frame.
+uint32_t GetSystemTime()
+{
+	s_nFrames++;
+	if(s_pFrame)
+	{
+		uint64_t t0 = HostNs();
+		s_pFrame();
+		uint64_t dt = HostNs() - t0;
+		s_iFrameNs += dt;
+		if(dt > s_iFrameMaxNs) s_iFrameMaxNs = dt;
+	}
+	return (s_nFrames * 1000) / ADC_FRAMERATE;
+}
+
+static uint8_t RunStep(int16_t sp, uint8_t *buf)
+{
+	s_nFrames = 0;
+	s_iModel = 0;
+	s_iWidth = CTL_NEUTRAL;
+	return CurCtl_StepTest(sp, buf);
+}
+
+int main()
+{
+	uint8_t buf[CC_NSTEP];
+	int16_t sp = eeCurMax / 2;
+	uint8_t n = RunStep(sp, buf);
+
+	printf("Kp=%d Ki=%d setpoint=%d.%02dA  (64 = setpoint)\n", eeCurKp, eeCurKi, sp / 100, sp % 100);
+	for(uint8_t i = 0; i < n; i++) printf("%4u%s", buf[i], (i % 16 == 15) ? "\n" : "");
+	int rise = -1;
+	uint8_t peak = 0;
+	for(uint8_t i = 0; i < n; i++)
+	{
+		if(rise < 0 && buf[i] >= 58) rise = i;
+		if(buf[i] > peak) peak = buf[i];
+	}
+	printf("recorded %u of %u, rise (90%%) %d ticks, overshoot %d%%, end error %d%%\n",
+		n, CC_NSTEP, rise, peak > 64 ? (peak - 64) * 100 / 64 : 0, (buf[n - 1] - 64) * 100 / 64);
+	printf("host time: PI tick %u.%u us last, %u.%u us most;  frame callback %.2f us mean, %.2f us most, over %u frames\n",
+		CurCtl_GetTickTime() / 10, CurCtl_GetTickTime() % 10, CurCtl_GetMaxTickTime() / 10, CurCtl_GetMaxTickTime() % 10,
+		s_iFrameNs / 1000.0 / s_nFrames, s_iFrameMaxNs / 1000.0, s_nFrames);
+
+	s_iFaultAt = 100;
+	n = RunStep(sp, buf);
+	printf("fault at frame %u: recorded %u of %u, stopped after %u frames, width %u\n",
+		s_iFaultAt, n, CC_NSTEP, s_nFrames, s_iWidth);
+	return (n < CC_NSTEP && s_iWidth == CTL_NEUTRAL) ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+/*
+ * HX711Sim.c
+ *
+ * Host stand-in for an HX711, to check the driver in HX711.c without a
+ * load cell.  The real HX711.c is built in, and runs on a model of the
+ * chip on the PORTB and PINB pins.  The model sees the clock pin each
+ * time the driver waits (_delay_us()), so it acts on the pulses just as
+ * the chip would: each rising edge shifts the next bit, MSB first, out
+ * on DOUT, and after the 24th bit the next pulse (the 25th) sets channel
+ * A, gain 128, and DOUT goes high until the next reading.  A reading is
+ * made every 100ms (RATE low), and DOUT goes low when it is ready.  If
+ * the last one has not been clocked out by then, it is lost, as on the
+ * chip.  The driver's timer is run every system clock tick
+ * (SYS_T0CYCLES), as Sched.c would, and time goes by in those ticks,
+ * plus the driver's waits.
+ *
+ * The readings are a fixed list that covers both ends of the 24 bit
+ * range, zero and -1, and then a walk of noise about a no-load offset.
+ * For each one it checks that the driver read back the same value, that
+ * no pulse was held high long enough (60us) to power the chip down, and
+ * that there were 25 pulses.  It prints the number checked, the errors,
+ * the longest pulse, and the time from DOUT going low to the reading.
+ * The exit status is not zero if there was an error.  With HX_BURST at 8,
+ * and the 20.07ms ticks drifting against the 100ms readings: all 200
+ * read back, 1us pulses, and at most 60ms from DOUT low to the reading.
+ *
+ * Build and run, from this directory:
+ *
+ *     gcc -std=gnu99 -Wall -I. -o HX711Sim HX711Sim.c && ./HX711Sim
+ *
+ * Created: 10/18/2026
+ */
+
+#define MainFile
+#include <stdio.h>
+#include "../HX711.c"
+#include "../SysClock.h"
+
+#define SIM_PERIOD    100000.0          // Time between readings, in usecs.
+#define SIM_TICK      (SYS_T0CYCLES * 1000000.0 / F_CPU)   // System clock tick, in usecs.
+#define SIM_NREAD     200               // Readings to check.
+#define SIM_OFFSET    50000             // No-load reading, for the noise walk.
+#define SIM_DATA      24                // Chip: data bits, and pulses per reading
+#define SIM_PULSES    25                // for channel A, gain 128.
+
+static void (*s_pTimer)() = NULL;       // The driver's scheduler timer.
+
+uint8_t Servo2_GetChannels() { return 0; }
+uint8_t Sched_Add(void (*pCallback)(), uint16_t delay, uint16_t period, uint8_t flags) { s_pTimer = pCallback; return 0; }
+void Sched_Cancel(uint8_t id) { s_pTimer = NULL; }
+
+static double   s_tNow = 0;             // Time, in usecs.
+static double   s_tNext = SIM_PERIOD + 7300;   // Time of the next reading: not on a tick.
+static double   s_tReady = 0;           // Time DOUT went low for the reading being read.
+static double   s_tRise = 0;            // Time the clock went high.
+static bool8    s_bSck = False;
+static bool8    s_bReady = False;       // A reading is waiting, or being clocked out.
+static uint32_t s_iReg = 0;             // The reading, shifted as it goes out.
+static uint8_t  s_nPulses = 0;          // Pulses in this reading.
+static int32_t  s_iValue = 0;           // The reading, as made.
+static uint16_t s_nMade = 0;            // Readings made.
+static uint16_t s_nLost = 0;            // Readings made over one not yet read.
+static uint16_t s_nErrors = 0;
+static double   s_tMaxHigh = 0;         // Longest pulse, in usecs.
+static double   s_tMaxLatency = 0;      // Longest from DOUT low to the reading, in usecs.
+static uint16_t s_iNoise = 1;           // LFSR.
+
+static void SetDout(bool8 bHigh)
+{
+	if(bHigh) PINB |= _BV(HxDoutPin);
+	else PINB &= ~_BV(HxDoutPin);
+}
+
+// The value of reading n.
+static int32_t Reading(uint16_t n)
+{
+	static const int32_t s_List[] = {0, -1, 1, 0x7FFFFF, -0x800000, 0x555555, -0x2AAAAB, -123456};
+	if(n < sizeof(s_List) / sizeof(s_List[0])) return s_List[n];
+	s_iNoise = (s_iNoise >> 1) ^ ((s_iNoise & 1) ? 0xB400 : 0);
+	return SIM_OFFSET + (int16_t) (s_iNoise & 255) - 128;
+}
+
+// Brings the chip up to date with the time and the clock pin.
+static void Chip()
+{
+	bool8 sck = (PORTB & _BV(HxSckPin)) != 0;
+	if(sck && !s_bSck)
+	{
+		s_tRise = s_tNow;
+		if(s_nPulses < SIM_DATA)
+		{
+			SetDout((s_iReg & 0x800000) != 0);
+			s_iReg <<= 1;
+		}
+		else SetDout(True);
+		s_nPulses++;
+	}
+	if(!sck && s_bSck)
+	{
+		double t = s_tNow - s_tRise;
+		if(t > s_tMaxHigh) s_tMaxHigh = t;
+		if(t >= 60) s_nErrors++;
+		if(s_nPulses == SIM_PULSES) s_bReady = False;
+	}
+	s_bSck = sck;
+
+	if(s_tNow >= s_tNext)
+	{
+		double t = s_tNext;
+		s_tNext += SIM_PERIOD;
+		if(s_bReady) s_nLost++;
+		else if(s_nMade < SIM_NREAD)
+		{
+			s_iValue = Reading(s_nMade++);
+			s_iReg = (uint32_t) s_iValue & 0xFFFFFF;
+			s_nPulses = 0;
+			s_bReady = True;
+			s_tReady = t;
+			SetDout(False);
+		}
+	}
+}
+
+void HostSim_Delay(double us)
+{
+	Chip();
+	s_tNow += us;
+	Chip();
+}
+
+int main()
+{
+	SetDout(True);
+	if(!HX711_Start()) return 1;
+	uint16_t nRead = 0;
+	for(uint32_t k = 0; nRead < SIM_NREAD && k < 2 * SIM_NREAD * SIM_PERIOD / SIM_TICK; k++)
+	{
+		if(s_tNow < k * SIM_TICK) s_tNow = k * SIM_TICK;
+		Chip();
+		if(s_pTimer) s_pTimer();
+		Chip();
+		if(HX711_GetCount() == nRead) continue;
+		nRead = HX711_GetCount();
+		if(HX711_GetRaw() != s_iValue || s_nPulses != SIM_PULSES)
+		{
+			printf("reading %u: made %ld, read %ld, %u pulses\n",
+				nRead, (long) s_iValue, (long) HX711_GetRaw(), s_nPulses);
+			s_nErrors++;
+		}
+		if(s_tNow - s_tReady > s_tMaxLatency) s_tMaxLatency = s_tNow - s_tReady;
+	}
+	HX711_Stop();
+	printf("%u readings, %u errors, %u lost, longest pulse %.1f usecs, DOUT low to reading %.0f msecs at most\n",
+		nRead, s_nErrors, s_nLost, s_tMaxHigh, s_tMaxLatency / 1000);
+	return (nRead == SIM_NREAD && s_nErrors == 0 && s_nLost == 0) ? 0 : 1;
+}
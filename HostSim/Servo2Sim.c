@@ -0,0 +1,247 @@
+/*
+ * Servo2Sim.c
+ *
+ * Host simulation of the edge timing in Servo2.c.  The real Servo2.c is
+ * built in: Servo2_SetWidth() builds the schedules, and the two Timer2
+ * ISRs and ArmEdge() run as they are.  Around them is a model of the
+ * CPU clock (in cycles), of Timer2 at F_CPU/8, and of the interrupt
+ * entry, and each time a pin changes the time is stamped.  TCNT2,
+ * TIFR2 and PORTB are read from the model, so the wait loop in
+ * ArmEdge() sees the timer run, and TOV2 is set when an overflow is
+ * pending.
+ *
+ * Timing model:  An ISR starts SIM_ENTRY cycles after its flag is set,
+ * plus 0 to 3 cycles to finish the current instruction.  Each register
+ * access in the ISRs costs SIM_ACCESS cycles, and an ISR takes
+ * SIM_EXIT cycles to return.  The two Timer2 ISRs share one entry time,
+ * so the difference between their prologues is not in the numbers.
+ * Another ISR can be modelled: one that runs every so many cycles and
+ * holds interrupts off for a while.  An edge due while it runs waits
+ * for it.
+ *
+ * Channel 0 is swept over the whole range, one usec per frame, so every
+ * low byte of the edge time is met.  Channel 1 is 3 usecs after it (its
+ * edge is waited for in the ISR), channel 2 stays at 1500, and channel 3
+ * is the same as channel 0 (the edges are merged).  For each pulse the
+ * error is the width on the pin less the width asked for.
+ *
+ * Measured, for the three cases in main():
+ *
+ *     Case                          Error, usecs      Missed edges
+ *     No other interrupts           -2.1 to  +1.3      0
+ *     Timer1 at 20KHz, 100 cycles  -11.5 to +10.9      0
+ *     ADC frame, 500 cycles         -2.1 to +49.6      0
+ *
+ * Up to 0.8 short is from the 0.8usec count.  With no other interrupts,
+ * the rest is the entry time: an edge made by the compare ISR is late by
+ * about as much as the start of the frame was, but one waited for in
+ * ArmEdge() is on the count, so that pulse is short by the entry time.
+ * Another ISR can hold off either edge, by up to its whole length.  The
+ * exit status is not zero if an edge was missed.
+ *
+ * Build and run, from this directory:
+ *
+ *     gcc -std=gnu99 -Wall -I. -o Servo2Sim Servo2Sim.c && ./Servo2Sim
+ *
+ * Created: 10/18/2026
+ */
+
+#define MainFile
+#include <stdio.h>
+#include <stdlib.h>
+#include <avr/io.h>
+
+#define SIM_ENTRY    12         // Cycles from the flag to the first line of an ISR.
+#define SIM_ACCESS   4          // Cycles for each register access in an ISR.
+#define SIM_EXIT     12         // Cycles to return from an ISR.
+#define SIM_T2OVF    2048       // Cycles per Timer2 overflow (256 counts at F_CPU/8).
+#define SIM_NEVER    0xFFFFFFFFFFFFFFFFULL
+
+static volatile uint8_t *SimTcnt2(volatile uint8_t *p);
+static volatile uint8_t *SimTifr2(volatile uint8_t *p);
+static volatile uint8_t *SimPortB(volatile uint8_t *p);
+static volatile uint8_t *SimAccess(volatile uint8_t *p);
+
+// The Timer2 registers and PORTB go through the model.  In each of these,
+// the name inside is not expanded again, so it is the variable itself.
+#define TCNT2  (*SimTcnt2(&TCNT2))
+#define TIFR2  (*SimTifr2(&TIFR2))
+#define PORTB  (*SimPortB(&PORTB))
+#define TIMSK2 (*SimAccess(&TIMSK2))
+#define OCR2A  (*SimAccess(&OCR2A))
+
+#include "../Servo2.c"
+#include "../ADC.h"
+
+#undef TCNT2
+#undef TIFR2
+#undef PORTB
+#undef TIMSK2
+#undef OCR2A
+
+uint8_t PWM_GetProtocol() { return PWM_SERVO50; }
+
+static uint64_t s_t = 0;                // CPU time, in cycles.
+static uint64_t s_t0 = 0;               // Time Timer2 was started.
+static uint64_t s_iOvfDone = 0;         // Last overflow that has been taken.
+static bool8 s_bInISR = False;
+
+static uint64_t s_iBusyPeriod = 0;      // Other ISR: period and length, in cycles.  0 = none.
+static uint64_t s_iBusyLen = 0;
+static uint64_t s_iBusyPhase = 0;
+
+static uint8_t  s_iPortSeen = 0;        // PORTB as last seen, and the time of the last write.
+static uint64_t s_tPort = 0;
+static uint64_t s_tRise[SV_NCHAN];
+static bool8    s_bHigh[SV_NCHAN];
+static uint16_t s_iNext[SV_NCHAN];      // Widths asked for, and the ones in this frame.
+static uint16_t s_iCur[SV_NCHAN];
+
+static int32_t  s_iErrMin, s_iErrMax;   // Width errors, in 10th of usecs (cycles).
+static uint32_t s_nPulses, s_nMissed;
+
+// Notes the pins that changed since the last access to PORTB.
+static void Flush()
+{
+	uint8_t d = PORTB ^ s_iPortSeen;
+	for(uint8_t c = 0; c < SV_NCHAN; c++)
+	{
+		if(!(d & _BV(SV_PIN(c)))) continue;
+		if(PORTB & _BV(SV_PIN(c)))
+		{
+			if(s_bHigh[c]) s_nMissed++;     // No falling edge last frame.
+			s_bHigh[c] = True;
+			s_tRise[c] = s_tPort;
+			s_iCur[c] = s_iNext[c];
+		}
+		else
+		{
+			int32_t err = (int32_t) (s_tPort - s_tRise[c]) - (int32_t) s_iCur[c] * (F_CPU / 1000000);
+			if(err < s_iErrMin) s_iErrMin = err;
+			if(err > s_iErrMax) s_iErrMax = err;
+			s_nPulses++;
+			s_bHigh[c] = False;
+		}
+	}
+	s_iPortSeen = PORTB;
+}
+
+static volatile uint8_t *SimAccess(volatile uint8_t *p)
+{
+	if(s_bInISR) s_t += SIM_ACCESS;
+	return p;
+}
+
+static volatile uint8_t *SimTcnt2(volatile uint8_t *p)
+{
+	Flush();
+	SimAccess(p);
+	*p = (uint8_t) ((s_t - s_t0) >> 3);
+	return p;
+}
+
+// TOV2 is set if the timer has wrapped since the last overflow was
+// taken.  Writes (to clear the flags) are ignored: the model keeps them.
+static volatile uint8_t *SimTifr2(volatile uint8_t *p)
+{
+	SimAccess(p);
+	*p = ((s_t - s_t0) / SIM_T2OVF > s_iOvfDone) ? _BV(TOV2) : 0;
+	return p;
+}
+
+static volatile uint8_t *SimPortB(volatile uint8_t *p)
+{
+	Flush();
+	SimAccess(p);
+	s_tPort = s_t;
+	return p;
+}
+
+// Returns when an ISR flagged at time t can start, after any other
+// ISR that holds it off.
+static uint64_t Dispatch(uint64_t t)
+{
+	if(t < s_t) t = s_t;
+	if(s_iBusyPeriod && t >= s_iBusyPhase)
+	{
+		uint64_t start = t - (t - s_iBusyPhase) % s_iBusyPeriod;
+		if(t < start + s_iBusyLen) t = start + s_iBusyLen;
+	}
+	return t + (rand() & 3) + SIM_ENTRY;
+}
+
+static void RunISR(uint64_t t, void (*pISR)())
+{
+	s_t = t;
+	s_bInISR = True;
+	pISR();
+	s_t += SIM_EXIT;
+	s_bInISR = False;
+	Flush();
+}
+
+static void SetWidth(uint8_t c, uint16_t w)
+{
+	s_iNext[c] = w;
+	Servo2_SetWidth(c, w);
+}
+
+static uint32_t Run(const char *name, uint64_t busyPeriod, uint64_t busyLen)
+{
+	s_iBusyPeriod = busyPeriod;
+	s_iBusyLen = busyLen;
+	s_iBusyPhase = 777;
+	s_iErrMin = INT32_MAX;
+	s_iErrMax = INT32_MIN;
+	s_nPulses = s_nMissed = 0;
+	for(uint8_t c = 0; c < SV_NCHAN; c++) s_bHigh[c] = False;
+
+	s_t = 0;
+	Servo2_On(SV_NCHAN, 1500);
+	for(uint8_t c = 0; c < SV_NCHAN; c++) s_iNext[c] = 1500;
+	s_t0 = s_t;
+	s_iOvfDone = 0;
+	s_iPortSeen = PORTB;
+
+	uint16_t nFrames = SV_MAXWIDTH - SV_MINWIDTH + 2;
+	for(uint64_t ovf = 1; ovf <= (uint64_t) nFrames * SV_FRAMEWRAPS; )
+	{
+		uint64_t tOvf = s_t0 + ovf * SIM_T2OVF;
+		uint64_t tCmp = SIM_NEVER;
+		if(TIMSK2 & _BV(OCIE2A)) tCmp = s_t0 + s_iOvfDone * SIM_T2OVF + OCR2A * 8;
+		if(tCmp <= tOvf)
+		{
+			// The compare vector is ahead of the overflow's.
+			uint64_t t = Dispatch(tCmp);
+			RunISR(t, TIMER2_COMPA_vect);
+			continue;
+		}
+		s_iOvfDone = ovf;
+		RunISR(Dispatch(tOvf), TIMER2_OVF_vect);
+		// Part way through the frame, after the pulses, the main
+		// loop sets the widths for the next frame.
+		if(ovf % SV_FRAMEWRAPS == 20)
+		{
+			uint16_t w = SV_MINWIDTH + ovf / SV_FRAMEWRAPS;
+			if(w > SV_MAXWIDTH) w = SV_MAXWIDTH;
+			SetWidth(0, w);
+			SetWidth(1, w + 3 > SV_MAXWIDTH ? SV_MAXWIDTH : w + 3);
+			SetWidth(2, 1500);
+			SetWidth(3, w);
+		}
+		ovf++;
+	}
+	Servo2_Off();
+	printf("%-30s %6u pulses, error %+5.1f to %+5.1f usecs, %u missed\n", name,
+		s_nPulses, s_iErrMin / 10.0, s_iErrMax / 10.0, s_nMissed);
+	return s_nMissed;
+}
+
+int main()
+{
+	Servo2_Init();
+	uint32_t nMissed = Run("No other interrupts", 0, 0);
+	nMissed += Run("Timer1 at 20KHz, 100 cycles", F_CPU / 20000, 100);
+	nMissed += Run("ADC frame, 500 cycles", F_CPU / ADC_FRAMERATE, 500);
+	return nMissed ? 1 : 0;
+}
@@ -0,0 +1,28 @@
+/*
+ * avr/eeprom.h, for the host simulations.  Build with MainFile
+ * defined, so the EEu8() etc. variables are defined with their
+ * defaults, and the reads just return them.  A simulation can
+ * change a setting by writing the variable.
+ *
+ * Created: 10/18/2026
+ */
+
+#ifndef HOSTSIM_EEPROM_H_
+#define HOSTSIM_EEPROM_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define EEMEM
+
+static inline uint8_t  eeprom_read_byte(const uint8_t *p)   { return *p; }
+static inline uint16_t eeprom_read_word(const uint16_t *p)  { return *p; }
+static inline uint32_t eeprom_read_dword(const uint32_t *p) { return *p; }
+static inline void eeprom_update_byte(uint8_t *p, uint8_t v)   { *p = v; }
+static inline void eeprom_update_word(uint16_t *p, uint16_t v) { *p = v; }
+static inline void eeprom_write_byte(uint8_t *p, uint8_t v)    { *p = v; }
+static inline void eeprom_write_word(uint16_t *p, uint16_t v)  { *p = v; }
+static inline void eeprom_read_block(void *d, const void *s, unsigned n)   { memcpy(d, s, n); }
+static inline void eeprom_update_block(const void *s, void *d, unsigned n) { memcpy(d, s, n); }
+
+#endif /* HOSTSIM_EEPROM_H_ */
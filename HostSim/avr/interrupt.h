@@ -0,0 +1,16 @@
+/*
+ * avr/interrupt.h, for the host simulations.  An ISR is a plain
+ * function, with the vector's name, that the simulation calls.
+ *
+ * Created: 10/18/2026
+ */
+
+#ifndef HOSTSIM_INTERRUPT_H_
+#define HOSTSIM_INTERRUPT_H_
+
+#define ISR(v, ...) void v(void); void v(void)
+#define ISR_NOBLOCK
+#define sei()
+#define cli()
+
+#endif /* HOSTSIM_INTERRUPT_H_ */
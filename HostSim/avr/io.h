@@ -0,0 +1,41 @@
+/*
+ * avr/io.h, for the host simulations.
+ *
+ * The registers are plain variables, defined here, so each simulation
+ * must be one translation unit (it #includes the modules it runs).
+ * Only the registers and bits used by the firmware are here.
+ *
+ * Created: 10/18/2026
+ */
+
+#ifndef HOSTSIM_IO_H_
+#define HOSTSIM_IO_H_
+
+#include <stdint.h>
+
+#define _BV(b) (1u << (b))
+
+#define R8(n)  volatile uint8_t n;
+#define R16(n) volatile uint16_t n;
+R8(PORTA) R8(PORTB) R8(PORTC) R8(PORTD) R8(DDRA) R8(DDRB) R8(DDRC) R8(DDRD) R8(PINA) R8(PINB) R8(PINC) R8(PIND)
+R8(ADCSRA) R8(ADCSRB) R8(ADMUX) R16(ADC) R8(ADCL) R8(ADCH) R8(DIDR0)
+R8(TCCR0A) R8(TCCR0B) R8(TCNT0) R8(OCR0A) R8(OCR0B) R8(TIMSK0) R8(TIFR0)
+R8(TCCR1A) R8(TCCR1B) R8(TCCR1C) R16(TCNT1) R16(OCR1A) R16(OCR1B) R16(ICR1) R8(TIMSK1) R8(TIFR1)
+R8(TCCR2A) R8(TCCR2B) R8(TCNT2) R8(OCR2A) R8(OCR2B) R8(TIMSK2) R8(TIFR2) R8(ASSR)
+R8(EICRA) R8(EIMSK) R8(EIFR) R8(PCICR) R8(PCIFR) R8(PCMSK0) R8(PCMSK1) R8(PCMSK2) R8(PCMSK3)
+R8(SPCR) R8(SPSR) R8(SPDR) R8(SREG) R8(MCUSR) R8(GPIOR0)
+#undef R8
+#undef R16
+
+enum
+{
+	ADEN=7, ADSC=6, ADATE=5, ADIF=4, ADIE=3, ADPS0=0, ADPS1=1, ADPS2=2, REFS0=6, REFS1=7, ADLAR=5, MUX0=0, ADTS0=0,
+	COM1A1=7, COM1A0=6, COM1B1=5, COM1B0=4, WGM11=1, WGM10=0, WGM13=4, WGM12=3, CS12=2, CS11=1, CS10=0, ICNC1=7, ICES1=6,
+	OCIE1A=1, OCIE1B=2, TOIE1=0, ICIE1=5, OCF1A=1, OCF1B=2, TOV1=0, OCIE0A=1, OCF0A=1, TOV0=0,
+	WGM01=1, WGM00=0, CS02=2, CS01=1, CS00=0,
+	WGM21=1, WGM20=0, WGM22=3, CS22=2, CS21=1, CS20=0, OCIE2A=1, OCIE2B=2, TOIE2=0, OCF2A=1, OCF2B=2, TOV2=0,
+	ISC00=0, ISC01=1, ISC10=2, ISC11=3, INT0=0, INT1=1, INTF0=0, INTF1=1,
+	PCIE0=0, PCIE1=1, PCIE2=2, PCIE3=3, PCIF3=3, PCINT26=2, PCINT27=3
+};
+
+#endif /* HOSTSIM_IO_H_ */
@@ -0,0 +1,27 @@
+/*
+ * avr/pgmspace.h, for the host simulations.  Program memory is just
+ * memory.  Note pgm_read_word() reads 16 bits, so it can't fetch a
+ * pointer from a PROGMEM table on a 64 bit host: the simulations
+ * don't use the name tables.
+ *
+ * Created: 10/18/2026
+ */
+
+#ifndef HOSTSIM_PGMSPACE_H_
+#define HOSTSIM_PGMSPACE_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define pgm_read_byte(p)  (*(const uint8_t *) (p))
+#define pgm_read_word(p)  (*(const uint16_t *) (p))
+#define pgm_read_dword(p) (*(const uint32_t *) (p))
+#define memcpy_P  memcpy
+#define strlen_P  strlen
+#define strcpy_P  strcpy
+#define strncpy_P strncpy
+
+#endif /* HOSTSIM_PGMSPACE_H_ */
@@ -0,0 +1,14 @@
+/*
+ * avr/sleep.h, for the host simulations.
+ *
+ * Created: 10/18/2026
+ */
+
+#ifndef HOSTSIM_SLEEP_H_
+#define HOSTSIM_SLEEP_H_
+
+#define SLEEP_MODE_IDLE 0
+#define set_sleep_mode(m)
+#define sleep_mode()
+
+#endif /* HOSTSIM_SLEEP_H_ */
@@ -0,0 +1,12 @@
+/*
+ * avr/wdt.h, for the host simulations.
+ *
+ * Created: 10/18/2026
+ */
+
+#ifndef HOSTSIM_WDT_H_
+#define HOSTSIM_WDT_H_
+
+#define wdt_reset()
+
+#endif /* HOSTSIM_WDT_H_ */
@@ -0,0 +1,15 @@
+/*
+ * util/atomic.h, for the host simulations.  There are no interrupts
+ * on the host, so a block just runs once.
+ *
+ * Created: 10/18/2026
+ */
+
+#ifndef HOSTSIM_ATOMIC_H_
+#define HOSTSIM_ATOMIC_H_
+
+#define ATOMIC_BLOCK(x) for(int _once = 1; _once; _once = 0)
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+
+#endif /* HOSTSIM_ATOMIC_H_ */
@@ -0,0 +1,17 @@
+/*
+ * util/delay.h, for the host simulations.  A delay calls
+ * HostSim_Delay(), which the simulation supplies, so that a model
+ * of an outside part can act in the time the firmware waits.
+ *
+ * Created: 10/18/2026
+ */
+
+#ifndef HOSTSIM_DELAY_H_
+#define HOSTSIM_DELAY_H_
+
+void HostSim_Delay(double us);
+
+#define _delay_us(us) HostSim_Delay(us)
+#define _delay_ms(ms) HostSim_Delay((ms) * 1000.0)
+
+#endif /* HOSTSIM_DELAY_H_ */
@@ -19,22 +19,62 @@
 #define MainFile
 #include "MainDef.h"
 #include "SysClock.h"
+#include "Sched.h"
 #include "UI.h"
 #include "ADC.h"
 #include "PWM.h"
+#include "Control.h"
+#include "CurCtl.h"
+#include "Profile.h"
+#include "PotCurve.h"
+#include "Sweep.h"
+#include "Seq.h"
+#include "Servo2.h"
+#include "Capture.h"
+#include "Tach.h"
+#include "Ripple.h"
+#include "Thermal.h"
+#include "Endurance.h"
+#include "Dyno.h"
 #include <string.h>
 #include <stdio.h>
 
 static void DoUI();
 static void ShowTitle();
 static void UpdateParams();
-static void ControlPWM(int16_t d, bool8 forward);
 static void RunMode();
-static void ShowMode();
+static void ThermalBar();
+static void MenuMode();
+static void SweepItem(MenuItem *pItem);
+static void SweepRunItem(MenuItem *pItem);
+static void SweepPlot();
+static void EnduranceItem(MenuItem *pItem);
+static void EnduranceRunItem(MenuItem *pItem);
+static void SetupItem(MenuItem *pItem);
+static void StepTestItem(MenuItem *pItem);
+static void FaultItem(MenuItem *pItem);
+static void CtlLoopItem(MenuItem *pItem);
+static void SeqItem(MenuItem *pItem);
+static void CaptureItem(MenuItem *pItem);
+static void TachItem(MenuItem *pItem);
+static void DynoItem(MenuItem *pItem);
+static void TachTypeDisplay(MenuItem *pItem, int16_t num, char *outbuf);
+static void ThermTauDisplay(MenuItem *pItem, int16_t num, char *outbuf);
+static void StallActDisplay(MenuItem *pItem, int16_t num, char *outbuf);
+static void ProfileItem(MenuItem *pItem);
+static void ProfileRunItem(MenuItem *pItem);
+static void ProfileNameDisplay(MenuItem *pItem, int16_t num, char *outbuf);
+static void ProtocolDisplay(MenuItem *pItem, int16_t num, char *outbuf);
+static void PotCurveDisplay(MenuItem *pItem, int16_t num, char *outbuf);
+static void CtlModeDisplay(MenuItem *pItem, int16_t num, char *outbuf);
 static void refreshTimer();
+static void BlinkLed();
 static int16_t GetPotMC();
 //uint32_t g_maxlooptime;
 static bool8 s_bForward = True;
+static bool8 s_bCurMode = False;	// True if the pot commands current instead of width.
+static uint8_t s_iProfile = 0;		// Profile selected for a profile run.
+static uint8_t s_nProfileLoops = 1;	// Number of times to play the profile.
 static int newTimerMax;
 static int ogCap = 300;	// This is the maximum amount of time the program can run without being refreshed.
 static int newTimerMax = 300;
@@ -62,16 +102,20 @@ int main(void)
     BitOn(PORTC, Button_2);
 
     SetupSystemTimeCounter();
-    SetSlowInterrupt(GetSystemTime() + 100);
+    Sched_Add(BlinkLed, 100, 100, SCHED_ISR);
     sei();
 
     UI_Setup();
 	ADC_Enable();
 	PWM_Init();
+	SetupFastTimer();
+	Control_Setup();
 
     LedRedOn();
 	
-	PWM_On(50, 1500);
+	PWM_On(eeprom_read_byte(&eePwmProtocol), 1500);
+	Servo2_Init();
+	Servo2_On(eeprom_read_byte(&eeServo2Chans), eeprom_read_word(&eeServo2Width));
 
     ShowTitle();
 	//g_maxlooptime = 0;
@@ -90,7 +134,10 @@ static void DoUI()
 			
 	uint8_t b = UI_GetButtons();
 	
-	int16_t d = GetPotMC();
+	// Run is only offered with the pot at neutral: the shaped command, so
+	// that with a bipolar curve it is the middle of the pot, not the end.
+	// The current loop takes its setpoint from the same shaped value.
+	int16_t d = PotCurve_Shape(GetPotMC());
 	
 	UI_Update();
 	
@@ -102,18 +149,18 @@ static void DoUI()
 			RunMode();
 			ShowTitle();
 		}
-		UI_Options(PSTR("Off"), PSTR("Show"), PSTR("Run"));
+		UI_Options(PSTR("Off"), PSTR("Menu"), PSTR("Run"));
 	}
 	
 	 else {
-		 UI_Options(PSTR("Off"), PSTR("Show"), PSTR("N/A"));
+		 UI_Options(PSTR("Off"), PSTR("Menu"), PSTR("N/A"));
 	 }
 
 	if(b & UI_B1)  
 	{
 		UI_DeBounce(UI_B1);
 		refreshTimer();
-		ShowMode();
+		MenuMode();
 		ShowTitle();
 		refreshTimer();
 	}
@@ -121,7 +168,7 @@ static void DoUI()
 	{
 		UI_DeBounce(UI_B2);
 		refreshTimer();
-		PwrRelayOff();
+		Seq_PowerOff();
 		ShowTitle();
 	}
 }
@@ -129,17 +176,41 @@ static void DoUI()
 // Writes the pot position, current and voltage to screen.
 static void UpdateParams()
 {
-	int16_t d = GetPotMC();
-	UI_NumXYS(26, 17, d, 4, U_Decimal | U_Signed);
+	Ripple_Poll();
+	int16_t d = PotCurve_Shape(GetPotMC());
+	if (s_bCurMode) {
+		UI_NumXYS(26, 17, CurCtl_GetSetpoint(), 5, U_Decimal | U_x100);
+	} else {
+		UI_NumXYS(26, 17, d, 4, U_Decimal | U_Signed);
+	}
 	int16_t v = ADC_GetBatteryVoltage();
 	UI_NumXYS(26, 26, v, 5, U_Decimal | U_x1000);
 	int16_t c = ADC_GetCurrent();
-	UI_NumXYS(26, 35, c, 5, U_Decimal | U_x100);
-	if (s_bForward) {
+	UI_NumXYS(26, 35, c, 5, U_Decimal | U_Signed | U_x100);
+	if (!s_bCurMode) s_bForward = Control_IsForward();
+	if (!s_bCurMode && Control_GetRevState() != CTL_REV_NONE) {
+		UI_StrXYSP(26, 44, PSTR("Rev... "));
+	} else if (s_bForward) {
 		UI_StrXYSP(26, 44, PSTR("Forward"));
 	} else {
 		UI_StrXYSP(26, 44, PSTR("Reverse"));	
 	}
+	if (Control_GetFault() & CTL_FAULT_STALL) {
+		UI_StrXYSP(70, 44, PSTR("STALL "));
+	} else if (Control_GetFault() & CTL_FAULT_THERMAL) {
+		UI_StrXYSP(70, 44, PSTR("HOT!  "));
+	} else if (Control_GetFault()) {
+		UI_StrXYSP(70, 44, PSTR("FAULT "));
+	} else if (Control_IsThrottled()) {
+		UI_StrXYSP(70, 44, PSTR("THROT "));
+	} else if (Thermal_GetDerate() < 4096) {
+		UI_StrXYSP(70, 44, PSTR("DERATE"));
+	} else if (Control_IsCompOn()) {
+		// Battery compensation flag and factor.
+		int16_t f = (int16_t) (((uint32_t) Control_GetCompFactor() * 100 + CTL_ONE/2) / CTL_ONE);
+		UI_StrXYSP(70, 44, PSTR("C"));
+		UI_NumXYS(76, 44, f, 4, U_Decimal | U_x100);
+	}
 	
 	//int16_t tt = (int16_t) g_maxlooptime;
 	//UI_NumXYS(0, 46, tt, 6, U_Decimal);
@@ -151,7 +222,7 @@ static void UpdateParams()
 	
 	
 	if (resetTime == newTimerMax) {					//auto shutdown function
-		PwrRelayOff();
+		Seq_PowerOff();
 	}
 	UI_Update();
 }
@@ -164,19 +235,39 @@ static void RunMode()
     UI_StrXYSP(0, 35, PSTR("Cur="));  UI_StrXYSP(65, 38, PSTR("Amps"));
 	UI_StrXYSP(0, 44, PSTR("Dir="));		
     UI_Options(PSTR("Off"), PSTR("Dir"), PSTR("Back"));
+	Control_Setup();
+	Control_ClearFault();
+	s_bCurMode = eeprom_read_byte(&eeCtlMode) ? True : False;
+	if (s_bCurMode) {
+		UI_StrXYSP(0, 17, PSTR("Set="));  UI_StrXYSP(65, 20, PSTR("Amps"));
+	}
 	UpdateParams();
     UI_Update();
-	MotorRelayOn();
+	// The drive is started once the sequencer has closed the relay.
+	bool8 bDriving = False;
+	Seq_Start();
 	while(1)
 	{
+		if (!bDriving && Seq_Poll() == SEQ_ON) {
+			bDriving = True;
+			if (s_bCurMode) CurCtl_Start(s_bForward);
+			else {
+				// The pot is read by the control interrupt, at a fixed rate.
+				Control_Drive(True, s_bForward);
+				Control_SetPotCommand(True);
+			}
+		}
 
-		int16_t d = GetPotMC();
+		int16_t d = PotCurve_Shape(GetPotMC());
 		
-		ControlPWM(d, s_bForward);
+		ThermalBar();
 		UpdateParams();			
 		uint8_t b = UI_GetButtons();
 		
-		if (d == 0) {
+		// In width mode, the direction can be changed at any time: the
+		// control tick ramps through neutral.  The current loop can only
+		// change direction at zero.
+		if (d == 0 || !s_bCurMode) {
 		
 		UI_Options(PSTR("Off"), PSTR("Dir"), PSTR("Back"));
 		
@@ -184,8 +275,12 @@ static void RunMode()
 		{
 				UI_DeBounce(UI_B1);
 				refreshTimer();
-				if (s_bForward) s_bForward = False;
-				else s_bForward = True;
+				if (s_bCurMode) {
+					s_bForward = !s_bForward;
+					CurCtl_SetForward(s_bForward);
+				} else {
+					Control_Reverse();
+				}
 		}
 		
 		}
@@ -200,14 +295,20 @@ static void RunMode()
 		{
 			UI_DeBounce(UI_B0);
 			refreshTimer();
-			MotorRelayOff();
+			if (s_bCurMode) CurCtl_Stop();
+			else Control_Drive(False, s_bForward);
+			s_bCurMode = False;
+			Seq_MotorOff();
 			return;
 		}
 		if(b & UI_B2)
 		{
 			UI_DeBounce(UI_B2);
 			refreshTimer();
-			PwrRelayOff();
+			if (s_bCurMode) CurCtl_Stop();
+			else Control_Drive(False, s_bForward);
+			s_bCurMode = False;
+			Seq_PowerOff();
 			return;
 		}
 	}
@@ -216,21 +317,730 @@ static void RunMode()
 	
 
 
-static void ShowMode()
+// Draws the motor heat as a bar, right of the title in run mode.  The
+// bar is full at the trip level, with a tick at the warning level.
+static void ThermalBar()
+{
+	uint16_t trip = eeprom_read_byte(&eeThermTrip);
+	uint16_t pct = Thermal_GetPercent();
+	if (pct > trip) pct = trip;
+	uint8_t n = (uint16_t) (pct * 46) / trip;
+	uint8_t w = 78 + (uint16_t) (eeprom_read_byte(&eeThermWarn) * 46) / trip;
+	UI_Bar(78, 2, 125, 9, n);
+	UI_Line(w, 0, w, 2);
+}
+
+static const char s_sSweep[] PROGMEM = "Sweep";
+static const char s_sSetup[] PROGMEM = "Setup";
+static const char s_sMenu[] PROGMEM = "MENU";
+static const char s_sSetupTitle[] PROGMEM = "SETUP";
+static const char s_sBattComp[] PROGMEM = "Bat Comp";
+static const char s_sBattNom[] PROGMEM = "Bat Nom";
+static const char s_sRampAcc[] PROGMEM = "Ramp Acc";
+static const char s_sRampDec[] PROGMEM = "Ramp Dec";
+static const char s_sStepTest[] PROGMEM = "Step Test";
+static const char s_sProfile[] PROGMEM = "Profile";
+static const char s_sLoops[] PROGMEM = "Loops";
+static const char s_sStart[] PROGMEM = "Start";
+static const char s_sCurLimit[] PROGMEM = "Cur Limit";
+static const char s_sCtlMode[] PROGMEM = "Ctl Mode";
+static const char s_sCurKp[] PROGMEM = "Cur Kp";
+static const char s_sCurKi[] PROGMEM = "Cur Ki";
+static const char s_sCurMax[] PROGMEM = "Cur Max";
+static const char s_sProtocol[] PROGMEM = "Protocol";
+static const char s_sPotCurve[] PROGMEM = "Pot Curve";
+static const char s_sSweepLo[] PROGMEM = "Lo";
+static const char s_sSweepHi[] PROGMEM = "Hi";
+static const char s_sSettle[] PROGMEM = "Settle";
+static const char s_sHbBrake[] PROGMEM = "HB Brake";
+static const char s_sServo2Ch[] PROGMEM = "Servo2 Ch";
+static const char s_sServo2Us[] PROGMEM = "Servo2 us";
+static const char s_sRevDwell[] PROGMEM = "Rev Dwell";
+static const char s_sDither[] PROGMEM = "Dither";
+static const char s_sHbDead[] PROGMEM = "HB Dead";
+static const char s_sFaults[] PROGMEM = "Faults";
+static const char s_sSeq[] PROGMEM = "Sequence";
+static const char s_sCapture[] PROGMEM = "Capture";
+static const char s_sTach[] PROGMEM = "Tach";
+static const char s_sTachPpr[] PROGMEM = "Tach PPR";
+static const char s_sCommSegs[] PROGMEM = "Comm Segs";
+static const char s_sThermTau[] PROGMEM = "Therm Tau";
+static const char s_sThermAmps[] PROGMEM = "Therm Amp";
+static const char s_sThermWarn[] PROGMEM = "Therm Wrn%";
+static const char s_sThermTrip[] PROGMEM = "Therm Trp%";
+static const char s_sSeqSettle[] PROGMEM = "Seq Settle";
+static const char s_sSeqRelay[] PROGMEM = "Seq Relay";
+static const char s_sStallAct[] PROGMEM = "Stall Act";
+static const char s_sStallAmps[] PROGMEM = "Stall Amp";
+static const char s_sStallCmd[] PROGMEM = "Stall Cmd";
+static const char s_sStallTime[] PROGMEM = "Stall ms";
+static const char s_sAvg[] PROGMEM = "Avg";
+static const char s_sEndurance[] PROGMEM = "Endurance";
+static const char s_sDyno[] PROGMEM = "Dyno";
+static const char s_sDynoScale[] PROGMEM = "Dyno Scale";
+static const char s_sOffset[] PROGMEM = "Offset";
+static const char s_sRunMs[] PROGMEM = "Run ms";
+static const char s_sOffMs[] PROGMEM = "Off ms";
+static const char s_sCycles[] PROGMEM = "Cycles";
+static const char s_sCtlLoop[] PROGMEM = "Ctl Loop";
+static const char s_sCtlRate[] PROGMEM = "Ctl Rate";
+
+static MenuItem s_MainMenu[] =
+{
+	// Name      Value  Lim0  Lim1  Access  Format  Display  Service
+	{s_sSweep,   NULL,  0,    0,    U_RAM,  0,      NULL,    SweepItem},
+	{s_sSetup,   NULL,  0,    0,    U_RAM,  0,      NULL,    SetupItem},
+	{s_sStepTest,NULL,  0,    0,    U_RAM,  0,      NULL,    StepTestItem},
+	{s_sProfile, NULL,  0,    0,    U_RAM,  0,      NULL,    ProfileItem},
+	{s_sFaults,  NULL,  0,    0,    U_RAM,  0,      NULL,    FaultItem},
+	{s_sSeq,     NULL,  0,    0,    U_RAM,  0,      NULL,    SeqItem},
+	{s_sCapture, NULL,  0,    0,    U_RAM,  0,      NULL,    CaptureItem},
+	{s_sTach,    NULL,  0,    0,    U_RAM,  0,      NULL,    TachItem},
+	{s_sEndurance,NULL, 0,    0,    U_RAM,  0,      NULL,    EnduranceItem},
+	{s_sDyno,    NULL,  0,    0,    U_RAM,  0,      NULL,    DynoItem},
+	{s_sCtlLoop, NULL,  0,    0,    U_RAM,  0,      NULL,    CtlLoopItem},
+};
+
+static MenuItem s_ProfileMenu[] =
 {
-	UI_NewScreen(PSTR("Not READY..."));
-	UI_Options(NULL, PSTR("Cont"), NULL);
+	{s_sProfile,  &s_iProfile,      0,  0,   U_RAM | U_08b, U_Decimal,  ProfileNameDisplay, NULL},
+	{s_sLoops,    &s_nProfileLoops, 1,  100, U_RAM | U_08b, U_Decimal,  NULL, NULL},
+	{s_sStart,    NULL,             0,  0,   U_RAM,         0,          NULL, ProfileRunItem},
+};
+
+static MenuItem s_SweepMenu[] =
+{
+	{s_sSweepLo,  &eeSweepLo,     -512,  512,   U_ROM | U_16b, U_Decimal | U_Signed, NULL, NULL},
+	{s_sSweepHi,  &eeSweepHi,     -512,  512,   U_ROM | U_16b, U_Decimal | U_Signed, NULL, NULL},
+	{s_sSettle,   &eeSweepSettle, 0,     5000,  U_ROM | U_16b, U_Decimal,            NULL, NULL},
+	{s_sAvg,      &eeSweepAvg,    1,     255,   U_ROM | U_08b, U_Decimal,            NULL, NULL},
+	{s_sStart,    NULL,           0,     0,     U_RAM,         0,                    NULL, SweepRunItem},
+};
+
+static MenuItem s_EnduranceMenu[] =
+{
+	{s_sOffset,   &eeEndOffset,   -512,  512,   U_ROM | U_16b, U_Decimal | U_Signed, NULL, NULL},
+	{s_sRunMs,    &eeEndRun,      100,   30000, U_ROM | U_16b, U_Decimal,            NULL, NULL},
+	{s_sOffMs,    &eeEndOff,      0,     30000, U_ROM | U_16b, U_Decimal,            NULL, NULL},
+	{s_sCycles,   &eeEndCycles,   0,     30000, U_ROM | U_16b, U_Decimal,            NULL, NULL},
+	{s_sStart,    NULL,           0,     0,     U_RAM,         0,                    NULL, EnduranceRunItem},
+};
+
+static MenuItem s_SetupMenu[] =
+{
+	{s_sProtocol, &eePwmProtocol, 0,     PWM_NPROTOCOLS-1, U_ROM | U_08b, U_Decimal, ProtocolDisplay, NULL},
+	{s_sDither,   &eePwmDither,   0,     1,     U_ROM | U_08b, U_YesNo,              NULL, NULL},
+	{s_sServo2Ch, &eeServo2Chans, 0,     SV_NCHAN, U_ROM | U_08b, U_Decimal,         NULL, NULL},
+	{s_sServo2Us, &eeServo2Width, 500,   2500,  U_ROM | U_16b, U_Decimal,            NULL, NULL},
+	{s_sHbBrake,  &eeHbBrake,     0,     1,     U_ROM | U_08b, U_YesNo,              NULL, NULL},
+	{s_sHbDead,   &eeHbDead,      0,     5000,  U_ROM | U_16b, U_Decimal,            NULL, NULL},
+	{s_sPotCurve, &eePotCurve,    0,     PC_NCURVES-1,     U_ROM | U_08b, U_Decimal, PotCurveDisplay, NULL},
+	{s_sBattComp, &eeBattComp,    0,     1,     U_ROM | U_08b, U_YesNo,              NULL, NULL},
+	{s_sBattNom,  &eeBattNominal, 6000,  16000, U_ROM | U_16b, U_Decimal | U_x1000,  NULL, NULL},
+	{s_sRampAcc,  &eeRampAccel,   0,     500,   U_ROM | U_16b, U_Decimal,            NULL, NULL},
+	{s_sRampDec,  &eeRampDecel,   0,     500,   U_ROM | U_16b, U_Decimal,            NULL, NULL},
+	{s_sSeqSettle,&eeSeqSettle,   0,     2000,  U_ROM | U_16b, U_Decimal,            NULL, NULL},
+	{s_sSeqRelay, &eeSeqRelay,    0,     2000,  U_ROM | U_16b, U_Decimal,            NULL, NULL},
+	{s_sRevDwell, &eeRevDwell,    0,     5000,  U_ROM | U_16b, U_Decimal,            NULL, NULL},
+	{s_sCtlRate,  &eeCtlRate,     0,     2000,  U_ROM | U_16b, U_Decimal,            NULL, NULL},
+	{s_sTach,     &eeTachType,    0,     TACH_RIPPLE, U_ROM | U_08b, U_Decimal,      TachTypeDisplay, NULL},
+	{s_sTachPpr,  &eeTachPpr,     1,     4096,  U_ROM | U_16b, U_Decimal,            NULL, NULL},
+	{s_sCommSegs, &eeRippleSegs,  1,     64,    U_ROM | U_08b, U_Decimal,            NULL, NULL},
+	{s_sDynoScale,&eeDynoScale,   -30000,30000, U_ROM | U_16b, U_Decimal | U_Signed, NULL, NULL},
+	{s_sCtlMode,  &eeCtlMode,     0,     1,     U_ROM | U_08b, U_Decimal,            CtlModeDisplay, NULL},
+	{s_sCurKp,    &eeCurKp,       0,     2000,  U_ROM | U_16b, U_Decimal,            NULL, NULL},
+	{s_sCurKi,    &eeCurKi,       0,     2000,  U_ROM | U_16b, U_Decimal,            NULL, NULL},
+	{s_sCurMax,   &eeCurMax,      100,   20000, U_ROM | U_16b, U_Decimal | U_x100,   NULL, NULL},
+	{s_sCurLimit, &eeCurLimit,    100,   25000, U_ROM | U_16b, U_Decimal | U_x100,   NULL, NULL},
+	{s_sStallAct, &eeStallAction, 0,     2,     U_ROM | U_08b, U_Decimal,            StallActDisplay, NULL},
+	{s_sStallAmps,&eeStallAmps,   100,   25000, U_ROM | U_16b, U_Decimal | U_x100,   NULL, NULL},
+	{s_sStallCmd, &eeStallMinCmd, 0,     512,   U_ROM | U_16b, U_Decimal,            NULL, NULL},
+	{s_sStallTime,&eeStallTime,   100,   10000, U_ROM | U_16b, U_Decimal,            NULL, NULL},
+	{s_sThermTau, &eeThermTau,    0,     TH_NTAUS-1, U_ROM | U_08b, U_Decimal,       ThermTauDisplay, NULL},
+	{s_sThermAmps,&eeThermRated,  100,   25000, U_ROM | U_16b, U_Decimal | U_x100,   NULL, NULL},
+	{s_sThermWarn,&eeThermWarn,   50,    250,   U_ROM | U_08b, U_Decimal,            NULL, NULL},
+	{s_sThermTrip,&eeThermTrip,   50,    250,   U_ROM | U_08b, U_Decimal,            NULL, NULL},
+};
+
+// Shows the main menu, from which the other modes and the
+// settings are reached.
+static void MenuMode()
+{
+	UI_Menu(s_sMenu, s_MainMenu, sizeof(s_MainMenu) / sizeof(MenuItem));
+	refreshTimer();
+}
+
+// Sets up and runs a motor characterisation sweep.
+static void SweepItem(MenuItem *pItem)
+{
+	UI_Menu(s_sSweep, s_SweepMenu, sizeof(s_SweepMenu) / sizeof(MenuItem));
+	refreshTimer();
+}
+
+// Runs the sweep, showing the progress, and then plots the results.
+static void SweepRunItem(MenuItem *pItem)
+{
+	UI_NewScreen(s_sSweep);
+	UI_StrXYSP(0, 17, PSTR("Step="));  UI_StrXYSP(54, 17, PSTR("of"));
+	UI_NumXYS(68, 17, SW_NSTEPS, 3, U_Decimal);
+	UI_StrXYSP(0, 26, PSTR("Width="));
+	UI_Options(NULL, NULL, PSTR("Stop"));
 	UI_Update();
-	while(1)
-	{
+
+	Control_ClearFault();
+	Seq_MotorOn();
+	if (Sweep_Start()) {
+		while (Sweep_GetState() == SW_RUNNING) {
+			uint8_t i = Sweep_GetStep();
+			if (i >= SW_NSTEPS) i = SW_NSTEPS - 1;
+			UI_NumXYS(30, 17, i + 1, 3, U_Decimal);
+			UI_NumXYS(36, 26, Sweep_GetOffset(i), 5, U_Decimal | U_Signed);
+			UI_Update();
+			if (UI_GetButtons() & UI_B0) {
+				UI_DeBounce(UI_B0);
+				Control_SetFault(CTL_FAULT_ABORT);
+				Sweep_Stop();
+			}
+		}
+	}
+	Seq_MotorOff();
+	refreshTimer();
+	if (Sweep_GetState() == SW_DONE) SweepPlot();
+	else UI_WaitOptions(NULL, NULL, PSTR("Back"));
+	refreshTimer();
+}
+
+// Plots the sweep results against the width: amps, volts or watts,
+// picked with the left button.  The plot is scaled to fit the range
+// of the values, which is shown on the right.
+static void SweepPlot()
+{
+	uint8_t iPlot = 0;
+	while (1) {
+		int16_t v[SW_NSTEPS];
+		SweepPoint pt;
+		for (uint8_t i = 0; i < SW_NSTEPS; i++) {
+			Sweep_GetPoint(i, &pt);
+			if (iPlot == 0)      v[i] = pt.Amps;
+			else if (iPlot == 1) v[i] = pt.Volts;
+			else                 v[i] = Sweep_GetWatts(i);
+		}
+		int16_t lo = v[0], hi = v[0];
+		for (uint8_t i = 1; i < SW_NSTEPS; i++) {
+			if (v[i] < lo) lo = v[i];
+			if (v[i] > hi) hi = v[i];
+		}
+		int16_t span = (hi > lo) ? hi - lo : 1;
+
+		// Plot area is 36 pixels high, and 4 pixels per step.
+		UI_NewScreen(s_sSweep);
+		UI_Line(0, 54, (SW_NSTEPS - 1) * 4, 54);
+		for (uint8_t i = 1; i < SW_NSTEPS; i++) {
+			uint8_t y0 = ((int32_t) (v[i-1] - lo) * 36) / span;
+			uint8_t y1 = ((int32_t) (v[i] - lo) * 36) / span;
+			UI_Line((i - 1) * 4, 54 - y0, i * 4, 54 - y1);
+		}
+		uint8_t fmt = (iPlot == 0) ? U_x100 : (iPlot == 1) ? U_x1000 : U_x10;
+		UI_NumXYS(98, 16, hi, 5, U_Decimal | fmt);
+		UI_NumXYS(98, 47, lo, 5, U_Decimal | fmt);
+		PGM_P pNext;
+		if (iPlot == 0)      { UI_StrXYSP(98, 31, PSTR("Amps"));  pNext = PSTR("Volts"); }
+		else if (iPlot == 1) { UI_StrXYSP(98, 31, PSTR("Volts")); pNext = PSTR("Watts"); }
+		else                 { UI_StrXYSP(98, 31, PSTR("Watts")); pNext = PSTR("Amps"); }
+		if (UI_WaitOptions(pNext, NULL, PSTR("Back")) == UI_B0) return;
+		refreshTimer();
+		if (++iPlot > 2) iPlot = 0;
+	}
+}
+
+// Sets up and runs an endurance test.
+static void EnduranceItem(MenuItem *pItem)
+{
+	UI_Menu(s_sEndurance, s_EnduranceMenu, sizeof(s_EnduranceMenu) / sizeof(MenuItem));
+	refreshTimer();
+}
+
+// Runs the endurance test, showing the count of cycles, and the last
+// cycle and the statistics across the cycles for one measurement at a
+// time, picked with the left button.  The statistics stay up after
+// the test ends.
+static void EnduranceRunItem(MenuItem *pItem)
+{
+	static const char s_sPeak[] PROGMEM = "Peak A";
+	static const char s_sMean[] PROGMEM = "Mean A";
+	static const char s_sEnergy[] PROGMEM = "Energy J";
+	static const char s_sTss[] PROGMEM = "Steady ms";
+	static PGM_P const s_Names[END_NMETRICS] PROGMEM = {s_sPeak, s_sMean, s_sEnergy, s_sTss};
+	static const uint8_t s_Formats[END_NMETRICS] PROGMEM = {U_x100, U_x100, U_x10, 0};
+
+	uint16_t nCycles = eeprom_read_word(&eeEndCycles);
+	uint8_t iMetric = 0;
+	bool8 bRunning = True;
+	Control_ClearFault();
+	Seq_MotorOn();
+	if (!Endurance_Start()) {
+		bRunning = False;
+		Seq_MotorOff();
+	}
+	while (1) {
+		Endurance_Poll();
+		if (bRunning && !Endurance_IsRunning()) {
+			bRunning = False;
+			Seq_MotorOff();
+			Endurance_Poll();
+		}
+		EndStats st;
+		Endurance_GetStats(iMetric, &st);
+		uint8_t fmt = U_Decimal | pgm_read_byte(&s_Formats[iMetric]);
+		UI_NewScreen(s_sEndurance);
+		UI_StrXYSP(0, 17, PSTR("Cycle="));
+		UI_NumXYS(36, 17, Endurance_GetCycles(), 5, U_Decimal | U_Unsigned);
+		if (nCycles != 0) {
+			UI_StrXYSP(68, 17, PSTR("of"));
+			UI_NumXYS(84, 17, nCycles, 5, U_Decimal);
+		}
+		UI_StrXYSP(0, 26, (PGM_P) pgm_read_word(&s_Names[iMetric]));
+		UI_NumXYS(66, 26, Endurance_GetLast(iMetric), 6, fmt);
+		UI_StrXYSP(0, 35, PSTR("Min="));  UI_NumXYS(24, 35, st.Min, 6, fmt);
+		UI_StrXYSP(66, 35, PSTR("Max="));  UI_NumXYS(90, 35, st.Max, 6, fmt);
+		UI_StrXYSP(0, 44, PSTR("Avg="));  UI_NumXYS(24, 44, st.Mean, 6, fmt);
+		UI_StrXYSP(66, 44, PSTR("Sd="));   UI_NumXYS(90, 44, st.StdDev, 6, fmt);
+		PGM_P pNext = (PGM_P) pgm_read_word(&s_Names[(iMetric + 1) % END_NMETRICS]);
+		UI_Options(pNext, NULL, bRunning ? PSTR("Stop") : PSTR("Back"));
+		UI_Update();
+
 		uint8_t b = UI_GetButtons();
-		if(b & UI_B1)
-		{
+		if (b & UI_B2) {
+			UI_DeBounce(UI_B2);
+			if (++iMetric >= END_NMETRICS) iMetric = 0;
+		}
+		if (b & UI_B0) {
+			UI_DeBounce(UI_B0);
+			if (!bRunning) break;
+			Control_SetFault(CTL_FAULT_ABORT);
+			Endurance_Stop();
+		}
+	}
+	// The auto shutdown is only checked in UpdateParams(), which this
+	// loop does not call, so it can't cut an unattended test short.
+	// It starts again from the full time.
+	refreshTimer();
+}
+
+static void SetupItem(MenuItem *pItem)
+{
+	UI_Menu(s_sSetupTitle, s_SetupMenu, sizeof(s_SetupMenu) / sizeof(MenuItem));
+	uint8_t iProtocol = eeprom_read_byte(&eePwmProtocol);
+	// Servo2 is stopped first: in the H-bridge mode, PWM_On() takes two
+	// of its pins for the direction inputs.
+	Servo2_Off();
+	if (iProtocol != PWM_GetProtocol()) PWM_On(iProtocol, 1500);
+	Servo2_On(eeprom_read_byte(&eeServo2Chans), eeprom_read_word(&eeServo2Width));
+	Control_Setup();
+	refreshTimer();
+}
+
+static void ProtocolDisplay(MenuItem *pItem, int16_t num, char *outbuf)
+{
+	strcpy_P(outbuf, PWM_ProtocolName(num));
+}
+
+static void TachTypeDisplay(MenuItem *pItem, int16_t num, char *outbuf)
+{
+	strcpy_P(outbuf, Tach_TypeName(num));
+}
+
+static void ThermTauDisplay(MenuItem *pItem, int16_t num, char *outbuf)
+{
+	ToDecimalStr(Thermal_GetTau(num), outbuf, U_Decimal | U_Unsigned);
+	strcat(outbuf, "s");
+}
+
+static void PotCurveDisplay(MenuItem *pItem, int16_t num, char *outbuf)
+{
+	strcpy_P(outbuf, PotCurve_Name(num));
+}
+
+static void StallActDisplay(MenuItem *pItem, int16_t num, char *outbuf)
+{
+	if (num == CTL_STALL_CUT)           strcpy_P(outbuf, PSTR("Cut"));
+	else if (num == CTL_STALL_THROTTLE) strcpy_P(outbuf, PSTR("Throttle"));
+	else                                strcpy_P(outbuf, PSTR("Off"));
+}
+
+static void CtlModeDisplay(MenuItem *pItem, int16_t num, char *outbuf)
+{
+	if (num) strcpy_P(outbuf, PSTR("Current"));
+	else     strcpy_P(outbuf, PSTR("Width"));
+}
+
+// Runs the current loop from zero to half of the max current, and
+// plots the measured current against the setpoint.  Also shows the
+// worst case time spent in one tick of the loop.
+static void StepTestItem(MenuItem *pItem)
+{
+	uint8_t buf[CC_NSTEP];
+	int16_t sp = eeprom_read_word((uint16_t *) &eeCurMax) / 2;
+
+	UI_NewScreen(PSTR("STEP TEST"));
+	UI_Update();
+	Seq_MotorOn();
+	uint8_t n = CurCtl_StepTest(sp, buf);
+	Seq_MotorOff();
+
+	// Plot area is 40 pixels high.  64 (the setpoint) is 32 pixels up.
+	UI_Line(0, 54, CC_NSTEP - 1, 54);
+	UI_Line(0, 22, CC_NSTEP - 1, 22);
+	for (uint8_t i = 1; i < n; i++) {
+		uint8_t y0 = buf[i-1] > 80 ? 80 : buf[i-1];
+		uint8_t y1 = buf[i] > 80 ? 80 : buf[i];
+		UI_Line(i - 1, 54 - y0/2, i, 54 - y1/2);
+	}
+	uint16_t us = CurCtl_GetMaxTickTime() / (F_CPU / 1000000);
+	UI_StrXYSP(98, 16, PSTR("Tick"));
+	UI_NumXYS(98, 25, us, 4, U_Decimal | U_Unsigned);
+	UI_StrXYSP(98, 34, PSTR("uSec"));
+	if (n < CC_NSTEP) {
+		// Stopped by a fault or the timeout.
+		UI_StrXYSP(98, 43, Control_GetFault() ? PSTR("FAULT") : PSTR("T/O"));
+	}
+	UI_WaitOptions(NULL, NULL, PSTR("Back"));
+	refreshTimer();
+}
+
+// Shows the latched faults, the time of the last stall, and the
+// time spent in the stall detector.
+static void FaultItem(MenuItem *pItem)
+{
+	UI_NewScreen(PSTR("FAULTS"));
+	uint8_t f = Control_GetFault();
+	UI_StrXYSP(0, 17, PSTR("Bits="));
+	UI_NumXYS(36, 17, f, 2, U_Hex2);
+	if (f & CTL_FAULT_OVERCURRENT) UI_StrXYSP(60, 17, PSTR("OC"));
+	if (f & CTL_FAULT_STALL)       UI_StrXYSP(78, 17, PSTR("Stall"));
+	if (f & CTL_FAULT_ABORT)       UI_StrXYSP(108, 17, PSTR("Ab"));
+	if (f & CTL_FAULT_THERMAL)     UI_StrXYSP(120, 17, PSTR("T"));
+	uint32_t t = Control_GetStallTime();
+	UI_StrXYSP(0, 26, PSTR("Stall at="));
+	if (t) {
+		UI_NumXYS(54, 26, (uint16_t) (t / 1000), 5, U_Decimal | U_Unsigned);
+		UI_StrXYSP(90, 26, PSTR("Sec"));
+	} else {
+		UI_StrXYSP(54, 26, PSTR("None"));
+	}
+	UI_StrXYSP(0, 35, PSTR("Det cyc="));
+	UI_NumXYS(54, 35, Control_GetStallCost(False), 5, U_Decimal | U_Unsigned);
+	UI_NumXYS(90, 35, Control_GetStallCost(True), 5, U_Decimal | U_Unsigned);
+	// Timers: overruns, misses, and the most late, in msecs.
+	SchedStats ss;
+	Sched_GetStats(&ss);
+	UI_StrXYSP(0, 44, PSTR("Tmr="));
+	UI_NumXYS(24, 44, ss.Overruns, 5, U_Decimal | U_Unsigned);
+	UI_NumXYS(57, 44, ss.Misses, 5, U_Decimal | U_Unsigned);
+	UI_NumXYS(90, 44, ss.MaxLate, 5, U_Decimal | U_Unsigned);
+	uint8_t b = UI_WaitOptions(PSTR("Clear"), NULL, PSTR("Back"));
+	if (b == UI_B2) {
+		Control_ClearFault();
+		Sched_ClearStats();
+	}
+	refreshTimer();
+}
+
+// Shows the fast control interrupt: the rate it runs at (the rate asked
+// for, rounded to whole PWM periods), the cycles it takes, last and
+// most, and the most jitter, in usecs.  Then the most cycles taken by
+// the control tick, and the ticks that overran (see PWM.c); "N" if the
+// tick runs nested, with interrupts on.
+static void CtlLoopItem(MenuItem *pItem)
+{
+	UI_NewScreen(PSTR("CONTROL LOOP"));
+	UI_StrXYSP(0, 17, PSTR("Rate="));  UI_StrXYSP(90, 17, PSTR("Hz"));
+	UI_StrXYSP(0, 26, PSTR("Cyc="));
+	UI_StrXYSP(0, 35, PSTR("Jit="));   UI_StrXYSP(90, 35, PSTR("uSec"));
+	UI_StrXYSP(0, 44, PSTR("Tick="));
+	UI_Options(PSTR("Clear"), NULL, PSTR("Back"));
+	while (True) {
+		PwmFastStats fs;
+		PWM_GetFastStats(&fs);
+		if (fs.Rate) UI_NumXYS(36, 17, fs.Rate, 5, U_Decimal | U_Unsigned);
+		else UI_StrXYSP(36, 17, PSTR("  Off"));
+		UI_NumXYS(24, 26, fs.Cost, 5, U_Decimal | U_Unsigned);
+		UI_NumXYS(60, 26, fs.MaxCost, 5, U_Decimal | U_Unsigned);
+		// A CPU cycle is 0.1us, so the jitter shows with U_x10.
+		UI_NumXYS(36, 35, fs.MaxJitter, 6, U_Decimal | U_Unsigned | U_x10);
+		PwmTickStats ts;
+		PWM_GetTickStats(&ts);
+		UI_NumXYS(30, 44, ts.MaxCost, 5, U_Decimal | U_Unsigned);
+		UI_NumXYS(66, 44, ts.Overruns, 5, U_Decimal | U_Unsigned);
+		UI_StrXYSP(102, 44, ts.bNested ? PSTR("N") : PSTR(" "));
+		UI_Update();
+		uint8_t b = UI_GetButtons();
+		if (b & UI_B2) {
+			UI_DeBounce(UI_B2);
+			PWM_ClearFastStats();
+			PWM_ClearTickStats();
+		}
+		if (b & UI_B0) {
+			UI_DeBounce(UI_B0);
+			break;
+		}
+	}
+	refreshTimer();
+}
+
+// Shows how long the last relay sequences took, in msecs, so the
+// settle and relay times can be trimmed.
+static void SeqItem(MenuItem *pItem)
+{
+	UI_NewScreen(PSTR("SEQUENCE"));
+	UI_StrXYSP(0, 17, PSTR("mSec"));  UI_StrXYSP(40, 17, PSTR("Neutral"));  UI_StrXYSP(88, 17, PSTR("Total"));
+	UI_StrXYSP(0, 26, PSTR("Start"));
+	UI_NumXYS(40, 26, Seq_GetTime(SEQ_T_NEUTRALUP), 5, U_Decimal | U_Unsigned);
+	UI_NumXYS(88, 26, Seq_GetTime(SEQ_T_UP), 5, U_Decimal | U_Unsigned);
+	UI_StrXYSP(0, 35, PSTR("Stop"));
+	UI_NumXYS(40, 35, Seq_GetTime(SEQ_T_NEUTRALDN), 5, U_Decimal | U_Unsigned);
+	UI_NumXYS(88, 35, Seq_GetTime(SEQ_T_DN), 5, U_Decimal | U_Unsigned);
+	UI_WaitOptions(NULL, NULL, PSTR("Back"));
+	refreshTimer();
+}
+
+// Measures the PWM signals on the capture pins, and shows for each
+// the width, the frequency, the jitter and the spread (max - min), in
+// usecs.  "Pass" sends channel 0 on to the motor, and shows the latency
+// that adds, last and most.
+static void CaptureItem(MenuItem *pItem)
+{
+	UI_NewScreen(PSTR("CAPTURE"));
+	UI_StrXYSP(0, 16, PSTR("Wid"));
+	UI_StrXYSP(0, 24, PSTR("Hz"));
+	UI_StrXYSP(0, 32, PSTR("Jit"));
+	UI_StrXYSP(0, 40, PSTR("P-P"));
+	UI_StrXYSP(0, 48, PSTR("Lat"));
+	UI_Options(PSTR("Pass"), PSTR("Reset"), PSTR("Back"));
+	Tach_Stop();             // The tach uses the same pins.
+	Capture_Start();
+
+	while (True) {
+		for (uint8_t i = 0; i < CAP_NCHAN; i++) {
+			CapStats cs;
+			Capture_GetStats(i, &cs);
+			uint8_t x = 30 + i * 48;
+			if (cs.n == 0) {
+				UI_StrXYSP(x, 16, PSTR("   --"));
+				UI_StrXYSP(x, 24, PSTR("     "));
+				UI_StrXYSP(x, 32, PSTR("     "));
+				UI_StrXYSP(x, 40, PSTR("     "));
+				continue;
+			}
+			// A CPU cycle is 0.1us, so the widths show with U_x10.
+			uint16_t hz = cs.PeriodAvg ? F_CPU / cs.PeriodAvg : 0;
+			UI_NumXYS(x, 16, cs.WidthAvg, 6, U_Decimal | U_Unsigned | U_x10);
+			UI_NumXYS(x, 24, hz, 6, U_Decimal | U_Unsigned);
+			UI_NumXYS(x, 32, cs.Jitter, 6, U_Decimal | U_Unsigned | U_x10);
+			UI_NumXYS(x, 40, cs.WidthMax - cs.WidthMin, 6, U_Decimal | U_Unsigned | U_x10);
+		}
+		UI_NumXYS(30, 48, Capture_GetLatency(False), 6, U_Decimal | U_Unsigned | U_x10);
+		UI_NumXYS(78, 48, Capture_GetLatency(True), 6, U_Decimal | U_Unsigned | U_x10);
+		UI_StrXYSP(36, 56, Capture_IsPassThrough() ? PSTR("*") : PSTR(" "));
+		UI_Update();
+
+		uint8_t b = UI_GetButtons();
+		if (b & UI_B0) {
+			UI_DeBounce(UI_B0);
+			break;
+		}
+		if (b & UI_B1) {
 			UI_DeBounce(UI_B1);
+			Capture_Reset();
+		}
+		if (b & UI_B2) {
+			UI_DeBounce(UI_B2);
+			if (Capture_IsPassThrough()) {
+				Capture_SetPassThrough(False);
+				Seq_MotorOff();
+			} else {
+				Control_ClearFault();
+				Seq_MotorOn();
+				if (!Capture_SetPassThrough(True)) Seq_MotorOff();
+			}
+		}
+	}
+	Capture_Stop();
+	Seq_MotorOff();
+	Tach_Setup();
+	refreshTimer();
+}
+
+// Shows the speed from the tach, as published with the ADC
+// readings, and the measurement mode in use.  For the ripple
+// estimate, shows the peak bin, and the time taken to analyse
+// a burst and by the longest step of it.
+static void TachItem(MenuItem *pItem)
+{
+	bool8 bRipple = (Tach_GetType() == TACH_RIPPLE);
+	UI_NewScreen(PSTR("TACH"));
+	UI_StrXYSP(0, 17, PSTR("Type="));
+	UI_StrXYSP(36, 17, Tach_TypeName(Tach_GetType()));
+	UI_StrXYSP(0, 26, PSTR("RPM="));
+	if (bRipple) {
+		UI_StrXYSP(0, 35, PSTR("Bin="));
+		UI_StrXYSP(0, 44, PSTR("mSec="));
+	} else {
+		UI_StrXYSP(0, 35, PSTR("Mode="));
+	}
+	UI_Options(NULL, NULL, PSTR("Back"));
+	while (!(UI_GetButtons() & UI_B0)) {
+		ADC_Snapshot snap;
+		Ripple_Poll();
+		ADC_GetSnapshot(&snap);
+		UI_NumXYS(36, 26, snap.Rpm, 6, U_Decimal | U_Signed);
+		if (bRipple) {
+			uint16_t ms = Ripple_GetCalcCycles() / (F_CPU / 10000);
+			uint16_t step = Ripple_GetSliceCycles() / (F_CPU / 10000);
+			UI_NumXYS(36, 35, Ripple_GetPeak(), 3, U_Decimal | U_Unsigned);
+			UI_NumXYS(36, 44, ms, 5, U_Decimal | U_Unsigned | U_x10);
+			UI_NumXYS(72, 44, step, 5, U_Decimal | U_Unsigned | U_x10);
+		} else {
+			UI_StrXYSP(36, 35, Tach_GetMode() == TACH_COUNT ? PSTR("Count ") : PSTR("Period"));
+		}
+		UI_Update();
+	}
+	UI_DeBounce(UI_B0);
+	refreshTimer();
+}
+
+// Runs the motor from the pot, as in run mode, and shows the torque
+// from the load cell, the power in and out, and the efficiency.  The
+// speed comes from the tach.  The load cell is zeroed with the motor
+// stopped: the drive is held at neutral while it zeros, at the start
+// and on "Zero" (which waits for the output to get to neutral first),
+// and after that until the pot is brought back to zero.
+static void DynoItem(MenuItem *pItem)
+{
+	UI_NewScreen(PSTR("DYNO"));
+	if (!Dyno_Start()) {
+		UI_StrXYSP(0, 26, Servo2_GetChannels() ? PSTR("Pins used by Servo2") : PSTR("No timer free"));
+		UI_WaitOptions(NULL, NULL, PSTR("Back"));
+		refreshTimer();
+		return;
+	}
+	UI_StrXYSP(0, 17, PSTR("Nm="));    UI_StrXYSP(66, 17, PSTR("RPM="));
+	UI_StrXYSP(0, 26, PSTR("In W="));
+	UI_StrXYSP(0, 35, PSTR("Out W="));
+	UI_StrXYSP(0, 44, PSTR("Eff%="));
+	UI_Options(PSTR("Zero"), NULL, PSTR("Back"));
+	Control_Setup();
+	Control_ClearFault();
+	bool8 bDriving = False;
+	bool8 bArmed = False;		// True once the pot is followed.
+	bool8 bZero = False;		// True while a zero waits for neutral.
+	Seq_Start();
+	while (1) {
+		if (!bDriving && Seq_Poll() == SEQ_ON) {
+			bDriving = True;
+			Control_Drive(True, s_bForward);
+		}
+		if (bZero && PWM_GetWidth() == CTL_NEUTRAL) {
+			bZero = False;
+			Dyno_Zero();
+		}
+		int16_t cmd = PotCurve_Shape(GetPotMC());
+		if (bZero || Dyno_IsZeroing()) bArmed = False;
+		else if (cmd == 0) bArmed = True;
+		Control_SetCommand(bArmed ? cmd : 0);
+		Dyno_Poll();
+		DynoReadings r;
+		Dyno_GetReadings(&r);
+		UI_NumXYS(18, 17, r.Torque, 7, U_Decimal | U_x1000);
+		UI_NumXYS(90, 17, r.Rpm, 6, U_Decimal);
+		UI_NumXYS(36, 26, r.ElecW, 6, U_Decimal | U_x10);
+		UI_NumXYS(36, 35, r.MechW, 6, U_Decimal | U_x10);
+		if (bZero || Dyno_IsZeroing()) {
+			UI_StrXYSP(36, 44, PSTR("Zeroing"));
+		} else if (!bArmed) {
+			UI_StrXYSP(36, 44, PSTR("Pot off"));
+		} else if (r.Eff < 0) {
+			UI_StrXYSP(36, 44, PSTR("    -- "));
+		} else {
+			UI_NumXYS(36, 44, r.Eff, 6, U_Decimal | U_x10);
+			UI_StrXYSP(72, 44, PSTR(" "));
+		}
+		UI_Update();
+
+		uint8_t b = UI_GetButtons();
+		if (b & UI_B2) {
+			UI_DeBounce(UI_B2);
 			refreshTimer();
-			return;
+			bZero = True;
+		}
+		if (b & UI_B0) {
+			UI_DeBounce(UI_B0);
+			break;
+		}
+	}
+	Control_Drive(False, s_bForward);
+	Seq_MotorOff();
+	Dyno_Stop();
+	refreshTimer();
+}
+
+static void ProfileNameDisplay(MenuItem *pItem, int16_t num, char *outbuf)
+{
+	strcpy_P(outbuf, Profile_Name(num));
+}
+
+// Picks a profile and the number of loops, and starts it.
+static void ProfileItem(MenuItem *pItem)
+{
+	s_ProfileMenu[0].Lim1 = Profile_Count() - 1;
+	UI_Menu(s_sProfile, s_ProfileMenu, sizeof(s_ProfileMenu) / sizeof(MenuItem));
+	refreshTimer();
+}
+
+// Plays the selected profile, showing the progress, until it is
+// done, it faults, or the operator stops it.
+static void ProfileRunItem(MenuItem *pItem)
+{
+	UI_NewScreen(s_sProfile);
+	UI_StrXYSP(0, 17, PSTR("Name="));  UI_StrXYSP(36, 17, Profile_Name(s_iProfile));
+	UI_StrXYSP(0, 26, PSTR("Seg="));
+	UI_StrXYSP(0, 35, PSTR("Loop="));  UI_StrXYSP(54, 35, PSTR("of"));
+	UI_NumXYS(68, 35, s_nProfileLoops, 3, U_Decimal);
+	UI_StrXYSP(65, 26, PSTR("Val="));
+	UI_Bar(0, 44, 101, 51, 0);
+	UI_Options(NULL, NULL, PSTR("Stop"));
+	UI_Update();
+
+	Control_ClearFault();
+	Seq_MotorOn();
+	if (Profile_Start(s_iProfile, s_nProfileLoops)) {
+		while (Profile_GetState() == PRF_RUNNING) {
+			UI_NumXYS(30, 26, Profile_GetKey() + 1, 3, U_Decimal);
+			UI_NumXYS(30, 35, Profile_GetLoop() + 1, 3, U_Decimal);
+			UI_NumXYS(89, 26, Profile_GetValue(), 5, U_Decimal | U_Signed);
+			uint8_t pct = Profile_GetPercent();
+			if (pct > 100) pct = 100;
+			UI_Bar(0, 44, 101, 51, pct);       // Redrawn in place, as it drops back at each loop.
+			UI_NumXYS(104, 44, pct, 3, U_Decimal);
+			UI_Update();
+			if (UI_GetButtons() & UI_B0) {
+				UI_DeBounce(UI_B0);
+				Control_SetFault(CTL_FAULT_ABORT);
+				Profile_Stop();
+			}
 		}
-	}	
+	}
+	Seq_MotorOff();
+
+	UI_NewScreen(s_sProfile);
+	if (Profile_GetState() == PRF_DONE) {
+		UI_StrXYSP(0, 17, PSTR("Done."));
+	} else {
+		UI_StrXYSP(0, 17, PSTR("Stopped. Fault="));
+		UI_NumXYS(96, 17, Control_GetFault(), 4, U_Hex | U_Hex2);
+	}
+	UI_WaitOptions(NULL, NULL, PSTR("Back"));
+	refreshTimer();
 }
 
 static void ShowTitle()
@@ -240,7 +1050,7 @@ static void ShowTitle()
 	UI_StrXYSP(0, 26, PSTR("Bat="));  UI_StrXYSP(65, 29, PSTR("Volts"));
 	UI_StrXYSP(0, 35, PSTR("Cur="));  UI_StrXYSP(65, 38, PSTR("Amps"));
 	UI_StrXYSP(0, 44, PSTR("Dir="));
-    UI_Options(PSTR("Off"), PSTR("Show"), PSTR("Run"));
+    UI_Options(PSTR("Off"), PSTR("Menu"), PSTR("Run"));
     UI_Update();
 }
 
@@ -249,30 +1059,13 @@ static void refreshTimer()
 		newTimerMax = ogCap + GetSystemTime()/1000;		
 }
 
-void SlowInterrupt()
+// Blinks the LED, to show the program is running.  Runs from the
+// tick interrupt, every 100ms.
+static void BlinkLed()
 {
     static bool8 bLed = False;
     if(bLed) {bLed = False; LedRedOff(); }
     else     {bLed = True; LedRedOn(); }
-    SetSlowInterrupt(GetSystemTime() + 100);
-	
-	// Dal's way
-	//if (timetolive <= 0 ) {
-		////dei here
-	//}
-	//timetolive--
-	
-}
-
-static void ControlPWM(int16_t d, bool8 forward)
-{
-	uint16_t width = 1500;
-	if (forward) {
-		width += d/2;
-	} else {
-		width -= d/2;
-	}
-	PWM_SetWidth(width);
 }
 
 static int16_t lastPotRead = 0; 
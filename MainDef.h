@@ -30,17 +30,24 @@
 #define ADC_BattVoltage 0
 #define ADC_PotInput    1
 #define ADC_CSense      2
+#define ADC_MotorTemp   3   // Motor case thermistor
+#define ADC_CtrlTemp    4   // Controller thermistor
 
 // Defines for PORT B pins.
 #define LedPin        0   // Led (output)
-#define BSpare1       1   // Unused
-#define BSpare2       2   // Unused
-#define BSpare3       3   // Unused
-#define BSpare4       4   // Unused
+#define BSpare1       1   // Servo2 channel 1, or HX711 clock, if used
+#define BSpare2       2   // Servo2 channel 2, or HX711 data, if used
+#define BSpare3       3   // Servo2 channel 3, or H-bridge 1A, if used
+#define BSpare4       4   // Servo2 channel 4, or H-bridge 2A, if used
 #define MOSIPin       5   // SPI for SD Reader and programming interface
 #define MISOPin       6   // SPI for SD Reader and programming interface
 #define SCKPin        7   // SPI for SD Reader and programming interface
 
+// In the H-bridge PWM mode, the PWM pin drives the SN754410 enable
+// (1,2EN), and two spare pins drive its direction inputs.
+#define HbDirAPin     BSpare3   // SN754410 input 1A (output)
+#define HbDirBPin     BSpare4   // SN754410 input 2A (output)
+
 // Defines for PORT C pins.
 #define Sw_MOnOffPin    0   // Switch on Pot, to control Motor Power Relay (input)
 #define Sw_PwrOnOffPin  1   // Power On/Off Switch (input)
@@ -54,8 +61,8 @@
 // Defines for PORT D
 #define LcdSclPin     0   // Unused
 #define LcdSiPin      1   // LCD control
-#define DSpare2       2   // Unused
-#define DSpare3       3   // Unused
+#define DSpare2       2   // Capture input, channel 0 (INT0), or tach / encoder A (PCINT26)
+#define DSpare3       3   // Capture input, channel 1 (INT1), or encoder B (PCINT27)
 #define PWMPin        4   // PWM to control motor speed (output)
 #define LcdCsPin      5   // LCD control
 #define LcdResetPin   6   // LCD control
@@ -83,8 +90,8 @@ typedef uint8_t bool8;
 // General routines.  
 void V0HardwareSetup();			// Call this for basic setup at power on.
 void SetupFastTimer();	        // Normally called at power on.
-void EnableFastTimerInterrupt(void (*pCallback)(), uint16_t Ticks);
-#define DisableFastTimerInterrupt() BitOff(TIMSK1, OCIE1A);
+void EnableFastTimerInterrupt(void (*pCallback)(), uint16_t Ticks);   // Ticks in usecs.  Runs on the PWM's Timer1, see PWM.c.
+void DisableFastTimerInterrupt();
 #define GetFastTime() (TCNT1)     // Returns the Timer1 Count.
 
 #ifdef MainFile
@@ -5,75 +5,721 @@
  * Updated: 10/24/2016
  *
  *  Author: Dal
- */ 
+ */
 
 // Note, this module configures and controls pin OC1B, which is otherwise
 // known as PD4.  On this pin, PWM is output.  If PWM is "off", then this
 // pin is left floating, otherwise it is an output and controlled by this module.
+//
+// Widths are always given as a standard servo width: 1000 to 2000 usecs,
+// with neutral at 1500.  The protocol table (s_Protocols) maps that onto
+// the pulses of each ESC protocol, along with the timer setup for its
+// frame rate.  For each protocol, the prescaler is the smallest that lets
+// the period fit in Timer1, so the pulse has the best resolution the timer
+// allows: 0.8us for 50Hz servo, and 0.1us for everything else.  Inside
+// this module widths are kept in 1/16 usecs, so that resolution is not
+// lost on the way to OCR1B.  The pulse count is found with a fixed point
+// multiply by a factor from the table -- no division.
+//
+// The width given to PWM_SetWidth() is only a target.  The output is moved
+// toward it by a ramp stage that runs in the Timer1 overflow interrupt, once
+// per tick.  A tick is PWM_TICKRATE per second no matter which protocol is
+// running: the ISR adds up the CPU cycles of each period, and runs a tick
+// each time F_CPU/PWM_TICKRATE cycles have gone by.  Moving away from
+// neutral is limited to the acceleration rate, and moving toward neutral
+// to the deceleration rate, both in usecs per tick.  A change of direction
+// first decelerates to neutral.  Only the ramp stage writes OCR1B, so the
+// ramp timing does not depend on how often the main loop gets around to
+// calling PWM_SetWidth().
+//
+// Widths are handed to the ISR through a mailbox with two slots.  The
+// writer fills the slot the ISR is not using, then marks it as the ready
+// one; the ISR takes the ready slot at the start of the next period.  So
+// each period outputs one whole width, whatever the main loop or another
+// interrupt was doing when the timer wrapped.  If more than one width is
+// written in a period, only the last is used, and the ones skipped are
+// counted (PWM_GetCoalesced()).
+//
+// The H-bridge protocol drives the SN754410 directly, with no ESC.  The
+// PWM pin runs the enable input (1,2EN) at 20KHz, with the duty set by the
+// offset from neutral (CTL_MAXOFFSET is full on), and the direction is
+// set on inputs 1A and 2A (HbDirAPin and HbDirBPin).  At neutral, the
+// bridge either coasts (enable low) or brakes (enable high, 1A = 2A = low,
+// so both motor leads are shorted to ground).  When the direction
+// changes, the enable is held low for a dead time before the direction
+// pins are switched, so the two halves of the bridge never fight.  This is
+// done in HBridgeStep(), every period.
+//
+// Dithering: at the fast rates there are only a few hundred counts per
+// period, so a count can be a big step in duty.  With dithering on, the
+// count is kept with 8 more bits of fraction, and a first order
+// sigma-delta in the overflow ISR adds the fraction to an 8 bit
+// accumulator each period; on a carry out, OCR1B gets one more count.
+// So OCR1B moves between the two counts either side of the wanted value,
+// and the average over 256 periods has the fractional bits.  It costs the
+// same every period: one 8 bit add, a carry test, a 16 bit add and the
+// OCR1B write, about 15 cycles.  Off by default, since at 50Hz the
+// averaging is too slow to be of use.
+//
+// Fast timer interrupt: EnableFastTimerInterrupt() hooks a callback that
+// runs from the overflow interrupt every few periods, for control laws
+// that want a fixed rate above the 50Hz tick.  Timer1 is taken by the PWM
+// (OCR1A is TOP, and in the PWM modes the compare registers only load at
+// BOTTOM), so the interval is rounded to a whole number of periods.  It
+// can't be shorter than one period: at 50Hz servo the callback runs at
+// 50Hz, which is as often as a new width can go out anyway.  Since it
+// counts periods, the rate has no drift and no beat, and the callback
+// runs first in the ISR, so the jitter is only the interrupt latency.
+// The cost of the callback, and the jitter (how far the time between two
+// calls is from the nominal), in cycles, are kept (PWM_GetFastStats()).
+//
+// The overflow interrupt runs every period, so the fast protocols cost more
+// CPU time.  At 20KHz (H-bridge) a period is 500 cycles, and the ISR
+// takes about 60 to 80 of them when it is not a tick.  The tick callback
+// (Control_Tick(), with the tach, thermal and stall work and the profile
+// engine) takes a few thousand cycles, which is several periods at the
+// fast rates.  The overflow flag only holds one, so if the tick ran with
+// interrupts off, periods would be lost, and s_iCycles, and so every
+// PWM_GetCycles() stamp, would fall behind.  So for periods under 1ms
+// (OneShot125 and faster), the ISR does the work for the period first,
+// and then runs the tick callback with interrupts on, so the overflows
+// during it are taken as they come.  Only one tick runs at a time.  The
+// slower protocols have a period of 2ms or more, and run the tick with
+// interrupts off, as before, so that the width it sets goes out in the
+// same period.  The cost of the tick callback, and the ticks that ran
+// too long (a period or more without nesting, or a whole tick with it),
+// are kept (PWM_GetTickStats()).
 
 #include "MainDef.h"
 #include "PWM.h"
-#define T1CLK (F_CPU/8)               // Input clock into counter (should be about 1.25MHz)
-#define T1CLK_SCALED (T1CLK/50000)    // Scaled version of T1CLK
-#define TSCALE 20                     // Other part of scale (x=1,000,000)
+#define NEUTRAL 1500                  // Neutral pulse width, in usecs.
+#define TICK_CYCLES (F_CPU / PWM_TICKRATE)   // CPU cycles per tick.
+#define NEST_CYCLES (F_CPU / 1000)           // Periods shorter than this run the tick nested.
+
+// Clock select bits.
+#define CS_DIV1  ((0<<CS12)|(0<<CS11)|(1<<CS10))
+#define CS_DIV8  ((0<<CS12)|(1<<CS11)|(0<<CS10))
+
+// Builds the fixed point factors that map a standard width, in 1/16 usecs,
+// to a pulse count:  count = (Width * Mul + Add) / 65536, where the pulse in
+// usecs is A * StdWidth + B, and the timer runs at CPU counts per usec.
+#define PWM_MUL(a, cpu)  ((uint32_t) ((a) * (cpu) * 4096.0 + 0.5))
+#define PWM_ADD(b, cpu)  ((int32_t) ((b) * (cpu) * 65536.0))
+#define PWM_TOP(hz, div) ((uint16_t) (F_CPU / (div) / (hz) - 1))
+
+// For the H-bridge: count = (|offset| * Mul) / 65536, with the offset in
+// 1/16 usecs, so that an offset of HB_FULL usecs is 100% duty.
+#define HB_FULL 512
+#define PWM_HBMUL(hz)    ((uint32_t) ((PWM_TOP(hz, 1) + 1) * 65536.0 / (HB_FULL * 16)))
+
+// Enable output for the H-bridge: PWM on OC1B, or held low.
+#define HB_ENPWM()  BitOn(TCCR1A, COM1B1)
+#define HB_ENOFF()  BitOff(TCCR1A, COM1B1)
+
+// H-bridge states.
+#define HB_OFF    0        // Enable low: coasting.
+#define HB_BRAKE  1        // Enable high, 1A and 2A low: braking.
+#define HB_FWD    2        // 1A high, enable is the PWM.
+#define HB_REV    3        // 2A high, enable is the PWM.
+
+typedef struct
+{
+	PGM_P pName;           // Name, for the menu.
+	uint16_t Top;          // Timer1 TOP.  The period is Top+1 counts.
+	uint8_t ClockSel;      // Timer1 clock select bits.
+	uint8_t Prescale;      // The matching prescale.
+	uint32_t Mul;          // Width to count: multiplier.  See PWM_MUL.
+	int32_t Add;           // Width to count: offset.  See PWM_ADD.
+	bool8 bHBridge;        // True to drive the SN754410 directly.  Mul is from PWM_HBMUL.
+} PwmProtocol;
+
+static const char s_sServo50[] PROGMEM = "Servo 50";
+static const char s_sServo333[] PROGMEM = "Servo 333";
+static const char s_sServo490[] PROGMEM = "Servo 490";
+static const char s_sOneShot125[] PROGMEM = "OneShot125";
+static const char s_sOneShot42[] PROGMEM = "OneShot42";
+static const char s_sMultiShot[] PROGMEM = "MultiShot";
+static const char s_sHBridge[] PROGMEM = "H-Bridge";
+
+static const PROGMEM PwmProtocol s_Protocols[PWM_NPROTOCOLS] =
+{
+	// Name         TOP                   Clock    Div  Mul                      Add                 HBridge
+	{s_sServo50,    PWM_TOP(50, 8),       CS_DIV8, 8,   PWM_MUL(1.0, 1.25),      0,                  False},  // 1000-2000us
+	{s_sServo333,   PWM_TOP(333, 1),      CS_DIV1, 1,   PWM_MUL(1.0, 10),        0,                  False},  // 1000-2000us
+	{s_sServo490,   PWM_TOP(490, 1),      CS_DIV1, 1,   PWM_MUL(1.0, 10),        0,                  False},  // 1000-2000us
+	{s_sOneShot125, PWM_TOP(3000, 1),     CS_DIV1, 1,   PWM_MUL(1.0/8, 10),      0,                  False},  // 125-250us
+	{s_sOneShot42,  PWM_TOP(8000, 1),     CS_DIV1, 1,   PWM_MUL(1.0/24, 10),     0,                  False},  // 41.7-83.3us
+	{s_sMultiShot,  PWM_TOP(16000, 1),    CS_DIV1, 1,   PWM_MUL(1.0/50, 10),     PWM_ADD(-15, 10),   False},  // 5-25us
+	{s_sHBridge,    PWM_TOP(20000, 1),    CS_DIV1, 1,   PWM_HBMUL(20000),        0,                  True},   // 0-100% duty
+};
+
 static bool8 s_bRunning = False;   // If not running, then the output pin is a simple GPIO, and driven low.
-static uint16_t s_iFreq = 50;      // Frequency of PWM in HZ.
-static uint16_t s_iWidth = 1500;   // Width of pwm pulse in usecs. Can run from about 500us to 2500us...
+static uint8_t s_iProtocol = PWM_SERVO50;   // Protocol being run.
+static volatile uint16_t s_Mail[2] = {NEUTRAL << 4, NEUTRAL << 4};   // Width mailbox, in 1/16 usecs.
+static volatile uint8_t s_iMailReady = 0;    // Slot holding the newest width.
+static volatile bool8 s_bMailNew = False;    // True if the ready slot has not been taken yet.
+static volatile uint16_t s_nCoalesced = 0;   // Widths replaced before the ISR took them.
+static volatile uint32_t s_iMailCycles = 0;  // Start of the period that first outputs the last width taken, in CPU cycles.
+static volatile uint32_t s_iSettledCycles = 0;  // Start of the last period in which the ramp was at the width taken, in CPU cycles.
+static uint16_t s_iWidth = NEUTRAL << 4;     // Target width of pwm pulse in 1/16 usecs. Can run from about 500us to 2500us...
+static volatile uint16_t s_iOutput = NEUTRAL << 4;  // Width being output now, in 1/16 usecs.  Owned by the ramp stage.
+static uint32_t s_iMul = 0;          // Width to count factors, for the running protocol.
+static int32_t  s_iAdd = 0;
+static uint32_t s_iPeriod = 0;       // CPU cycles per period.
+static uint32_t s_iTickAcc = 0;      // CPU cycles since the last tick.
+static volatile uint32_t s_iCycles = 0;      // CPU cycles at the start of this period.
+static uint8_t  s_iPrescale = 8;     // Timer1 prescale.
+static int16_t  s_iAccel = 0;        // Ramp limit away from neutral, 1/16 usecs per tick.  0 = no limit.
+static int16_t  s_iDecel = 0;        // Ramp limit toward neutral, 1/16 usecs per tick.  0 = no limit.
+static void (*s_pTickCallback)() = NULL;    // Called from the ISR once per tick, before the ramp stage.
+static bool8    s_bHBridge = False;  // True when driving the H-bridge directly.
+static bool8    s_bHbBrake = False;  // H-bridge: brake at neutral, instead of coast.
+static uint16_t s_iHbDeadUs = 0;     // H-bridge: dead time, in usecs.
+static uint8_t  s_nHbDead = 0;       // H-bridge: dead time, in periods.
+static uint8_t  s_iHbOff = 0;        // H-bridge: periods the bridge has been off, up to s_nHbDead.
+static uint8_t  s_iHbState = 0;      // H-bridge: HB_xxx state of the pins.
+static bool8    s_bDither = False;   // True to dither OCR1B.
+static uint16_t s_iCount = 0;        // Whole part of the pulse count.
+static uint8_t  s_iFrac = 0;         // Fractional part of the pulse count, in 1/256ths.
+static uint8_t  s_iDitherAcc = 0;    // Sigma-delta accumulator.
+static void (*s_pFastCallback)() = NULL;    // Called from the ISR every s_nFastDiv periods.
+static uint16_t s_iFastUs = 0;       // Fast interval asked for, in usecs.
+static uint8_t  s_nFastDiv = 1;      // Periods per fast call.
+static uint8_t  s_iFastCount = 1;    // Periods left till the next fast call.
+static bool8    s_bFastPrimed = False;       // True once s_iFastLast is set.
+static uint32_t s_iFastLast = 0;     // Start of the last fast call, in CPU cycles.
+static volatile uint16_t s_iFastCost = 0;    // Cycles taken by the last fast call,
+static volatile uint16_t s_iFastMaxCost = 0; // and the most taken.
+static volatile uint16_t s_iFastMaxJit = 0;  // Most jitter between fast calls, in cycles.
+static bool8    s_bNestTick = False; // True to run the tick callback with interrupts on.
+static volatile bool8 s_bInTick = False;     // True while a nested tick callback runs.
+static volatile uint16_t s_iTickCost = 0;    // Cycles taken by the last tick callback,
+static volatile uint16_t s_iTickMaxCost = 0; // and the most taken.
+static volatile uint16_t s_nTickOverruns = 0;   // Ticks that ran too long.  See RunTick().
+
+static int16_t RampStep(int16_t v, int16_t target, int16_t limit);
+static uint32_t WidthToCount(uint16_t width);
+static void SetCount(uint32_t c);
+static void HBridgeStep();
+static void HBridgeDeadTime();
+static void FastDivider();
+static void RunFast();
+static void RunTick();
+static void Output(bool8 bTick);
 
 // Init the PWM output pin.  Leaves it in a floating state until the
 // PWM is turned on with PWM_On().
 void PWM_Init()
 {
 	//BitOff(PORTD, PWMPin);
-	BitOff(DDRD, PWMPin);  
+	BitOff(DDRD, PWMPin);
 	s_bRunning = False;
 }
 
-// Turn on the PWM and set its initial frequency in Hz, and pulse width
-// in usec.  The pulse width should be between 500 and 2500 usec.
-void PWM_On(uint16_t freq, uint16_t width)
+// Turn on the PWM with the given protocol (PWM_xxx, see PWM.h) and
+// initial pulse width in usec.  The pulse width should be between 500
+// and 2500 usec.  The output starts at the given width without ramping.
+void PWM_On(uint8_t iProtocol, uint16_t width)
 {
-	s_iFreq = freq;
-	s_iWidth = width;
-	
-	uint16_t topcnt = T1CLK / s_iFreq;            // Calculate top count
-	uint16_t pulsecnt = s_iWidth * T1CLK_SCALED / TSCALE;  // Calculate pulse count 
+	if(iProtocol >= PWM_NPROTOCOLS) iProtocol = PWM_SERVO50;
+	const PwmProtocol *pP = &s_Protocols[iProtocol];
+	uint16_t topcnt = pgm_read_word(&pP->Top);
+	uint8_t clocksel = pgm_read_byte(&pP->ClockSel);
 
-    // Set up the control registers to output on the OC1B pin, and not
-	// use the OC1A pin, running fast PWM (Mode=15).  In this mode, OCR1A
-	// is used to set the count TOP, and OCR1B is used to set the pulse width.
-	
 	// Start with everything off.
 	TCCR1A = 0;
 	TCCR1B = 0;
 	TCCR1C = 0;
-	TIMSK1 = 0;  // Not using interrupts
-	
+	TIMSK1 = 0;  // No interrupts till it is set up
+
+	if(s_bHBridge)
+	{
+		// Leaving the H-bridge mode: let go of the direction pins.
+		BitOff(PORTB, HbDirAPin);
+		BitOff(PORTB, HbDirBPin);
+	}
+	s_iProtocol = iProtocol;
+	s_bHBridge = pgm_read_byte(&pP->bHBridge);
+	s_iMul = pgm_read_dword(&pP->Mul);
+	s_iAdd = (int32_t) pgm_read_dword(&pP->Add);
+	s_iPrescale = pgm_read_byte(&pP->Prescale);
+	s_iPeriod = (uint32_t) (topcnt + 1) * s_iPrescale;
+	s_bNestTick = (s_iPeriod < NEST_CYCLES);
+	s_iTickAcc = 0;
+	s_bMailNew = False;
+	s_Mail[s_iMailReady] = width << 4;
+	s_iWidth = width << 4;
+	s_iOutput = width << 4;
+	HBridgeDeadTime();
+	FastDivider();
+
+    // Set up the control registers to output on the OC1B pin, and not
+	// use the OC1A pin, running fast PWM (Mode=15).  In this mode, OCR1A
+	// is used to set the count TOP, and OCR1B is used to set the pulse width.
+
 	// Start at zero count
 	TCNT1 = 0;
-	
+
 	// Set the top count and the width count
 	OCR1A = topcnt;
-	OCR1B = pulsecnt;
+	SetCount(WidthToCount(s_iOutput));
 
 	// Set up the control registers
 	TCCR1A|=(0<<COM1A1)|(0<<COM1A0);  // Don't use OC1A pin
 	TCCR1A|=(1<<COM1B1)|(0<<COM1B0);  // Use OC1BW with compare match in non-inverted mode
 	TCCR1A|=(1<<WGM11)|(1<<WGM10);    // First Part of mode bits for mode 15
 	TCCR1B|=(1<<WGM13)|(1<<WGM12);    // Second part of mode bits for mode 15
-	TCCR1B|=(0<<CS12)|(1<<CS11)|(0<<CS10);  // Clock select, divide by 8     
-	
+	TCCR1B|=clocksel;                 // Clock select, from the protocol
+	TIMSK1 = _BV(TOIE1);              // Overflow interrupt runs the ramp stage
+
+	if(s_bHBridge)
+	{
+		// Start with the bridge off.  HBridgeStep() takes it from there.
+		SetCount(0);
+		HB_ENOFF();
+		BitOff(PORTD, PWMPin);
+		BitOff(PORTB, HbDirAPin);
+		BitOff(PORTB, HbDirBPin);
+		BitOn(DDRB, HbDirAPin);
+		BitOn(DDRB, HbDirBPin);
+		s_iHbState = HB_OFF;
+		s_iHbOff = 0;
+	}
+
 	// At this point, PWM should be running
 	BitOn(DDRD, PWMPin);
 	s_bRunning = True;
 }
 
-// Sets the PWM width, given in usecs.
+// Sets the target PWM width, given in usecs.  The output moves
+// toward it at the ramp rates.
 void PWM_SetWidth(uint16_t width)
 {
-	s_iWidth = width;	
-	uint16_t pulsecnt = s_iWidth * T1CLK_SCALED / TSCALE;  // Calculate pulse count
-	OCR1B = pulsecnt;
+	PWM_SetWidthQ4(width << 4);
+}
+
+// Sets the target PWM width, given in 1/16 usecs.  Use this when
+// more than 1us of resolution is wanted.  Safe to call from the main
+// loop or from an interrupt.
+void PWM_SetWidthQ4(uint16_t width)
+{
+	// Interrupts are off for the few cycles it takes to fill the slot,
+	// so that a writer in an interrupt can't pick the same slot while the
+	// main loop is half way through it.
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		uint8_t i = s_iMailReady ^ 1;
+		s_Mail[i] = width;
+		s_iMailReady = i;
+		if(s_bMailNew) s_nCoalesced++;
+		s_bMailNew = True;
+	}
+}
+
+// Returns the number of widths that were replaced by a newer one
+// before they could be output.
+uint16_t PWM_GetCoalesced()
+{
+	uint16_t n;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		n = s_nCoalesced;
+	}
+	return n;
+}
+
+// Returns the PWM width being output now, in usecs.
+uint16_t PWM_GetWidth()
+{
+	return (PWM_GetWidthQ4() + 8) >> 4;
+}
+
+// Returns the PWM width being output now, in 1/16 usecs.
+uint16_t PWM_GetWidthQ4()
+{
+	uint16_t w;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		w = s_iOutput;
+	}
+	return w;
+}
+
+// Returns the time, in CPU cycles (see PWM_GetCycles()), of the start
+// of the period in which the last width set was first output.  If the
+// ramp is on, that is only the start of the move toward it.
+uint32_t PWM_GetMailCycles()
+{
+	uint32_t t;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		t = s_iMailCycles;
+	}
+	return t;
+}
+
+// Returns the time, in CPU cycles (see PWM_GetCycles()), of the start
+// of the last period in which the ramp was found at the width it had
+// taken.  A width set at time t has been reached once this is later
+// than t, even if newer widths have been set since.
+uint32_t PWM_GetSettledCycles()
+{
+	uint32_t t;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		t = s_iSettledCycles;
+	}
+	return t;
+}
+
+// Sets the ramp limits, in usecs per tick.  Accel applies when
+// moving away from neutral, and decel when moving toward it.  Zero
+// means no limit.
+void PWM_SetRamp(uint16_t accel, uint16_t decel)
+{
+	if(accel > 1000) accel = 1000;
+	if(decel > 1000) decel = 1000;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		s_iAccel = accel << 4;
+		s_iDecel = decel << 4;
+	}
+}
+
+// Sets a routine to be called once per tick, from the Timer1 overflow
+// interrupt, just before the ramp stage.  Widths it sets with
+// PWM_SetWidth() are used in the same tick.  Pass NULL to remove it.
+void PWM_SetTickCallback(void (*pCallback)())
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		s_pTickCallback = pCallback;
+	}
+}
+
+// --------------------------------------------------------
+// SetupFastTimer()
+// Turns the fast timer interrupt off and clears its stats.  Call at
+// power on.  Timer1 itself is set up by PWM_On().
+void SetupFastTimer()
+{
+	DisableFastTimerInterrupt();
+	PWM_ClearFastStats();
+}
+
+// --------------------------------------------------------
+// EnableFastTimerInterrupt()
+// Calls pCallback from the Timer1 overflow interrupt, every Ticks
+// usecs, rounded to a whole number of PWM periods.  See the notes at
+// the top.  The callback runs with interrupts off, before the tick.
+void EnableFastTimerInterrupt(void (*pCallback)(), uint16_t Ticks)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		s_iFastUs = Ticks;
+		FastDivider();
+		s_pFastCallback = pCallback;
+	}
+}
+
+// Stops the fast callback.
+void DisableFastTimerInterrupt()
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		s_pFastCallback = NULL;
+	}
+}
+
+// Gets the rate the fast callback is running at, its cost and its
+// jitter.  The rate is zero if it is off.
+void PWM_GetFastStats(PwmFastStats *pStats)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		uint32_t n = (uint32_t) s_nFastDiv * s_iPeriod;
+		pStats->Rate = (s_pFastCallback && n) ? (F_CPU + n / 2) / n : 0;
+		pStats->Cost = s_iFastCost;
+		pStats->MaxCost = s_iFastMaxCost;
+		pStats->MaxJitter = s_iFastMaxJit;
+	}
+}
+
+// Gets the cost of the tick callback, and the overruns.  See
+// RunTick().
+void PWM_GetTickStats(PwmTickStats *pStats)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		pStats->Cost = s_iTickCost;
+		pStats->MaxCost = s_iTickMaxCost;
+		pStats->Overruns = s_nTickOverruns;
+		pStats->bNested = s_bNestTick;
+	}
+}
+
+// Clears the tick stats.
+void PWM_ClearTickStats()
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		s_iTickCost = 0;
+		s_iTickMaxCost = 0;
+		s_nTickOverruns = 0;
+	}
+}
+
+// Clears the most cost and jitter of the fast callback.
+void PWM_ClearFastStats()
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		s_iFastCost = 0;
+		s_iFastMaxCost = 0;
+		s_iFastMaxJit = 0;
+		s_bFastPrimed = False;
+	}
+}
+
+// Sets how the H-bridge protocol stops: brake (True) or coast (False)
+// at neutral, and the dead time, in usecs, on a change of direction.
+void PWM_SetHBridge(bool8 bBrake, uint16_t deadUs)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		s_bHbBrake = bBrake;
+		s_iHbDeadUs = deadUs;
+		HBridgeDeadTime();
+	}
+}
+
+// Returns the protocol being run.
+uint8_t PWM_GetProtocol()
+{
+	return s_iProtocol;
+}
+
+// Returns the name of a protocol, in PROGMEM.
+PGM_P PWM_ProtocolName(uint8_t iProtocol)
+{
+	if(iProtocol >= PWM_NPROTOCOLS) iProtocol = PWM_SERVO50;
+	return (PGM_P) pgm_read_word(&s_Protocols[iProtocol].pName);
+}
+
+// Returns a running count of CPU cycles, based on Timer1.  Good for
+// timing short things, even from inside other interrupts.  Rolls over
+// about every 7 minutes.  Only valid while the PWM is on.
+uint32_t PWM_GetCycles()
+{
+	uint32_t base;
+	uint16_t t;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		base = s_iCycles;
+		t = TCNT1;
+		// If the timer has wrapped but the ISR has not run yet, the
+		// base is one period behind.
+		if(BitTest(TIFR1, TOV1) && t < (OCR1A >> 1)) base += s_iPeriod;
+	}
+	return base + (uint32_t) t * s_iPrescale;
+}
+
+// Timer1 overflow, once per PWM period.  Runs a tick, which includes the
+// ramp stage, once every TICK_CYCLES.  The mailbox is emptied every
+// period (and after the tick callback), and with no ramp limits the new
+// width is output in the same period.  The new OCR1B is buffered by the
+// hardware and takes effect at the start of the next period.
+//
+// For the fast protocols (s_bNestTick), the tick callback runs last, with
+// interrupts on, so that the overflows it spans are not lost; see the
+// notes at the top.  The ramp step for the tick is then done after it.
+ISR(TIMER1_OVF_vect)
+{
+	bool8 bTick = False;
+	s_iCycles += s_iPeriod;
+	if(s_pFastCallback && --s_iFastCount == 0)
+	{
+		s_iFastCount = s_nFastDiv;
+		RunFast();
+	}
+	s_iTickAcc += s_iPeriod;
+	if(s_iTickAcc >= TICK_CYCLES)
+	{
+		s_iTickAcc -= TICK_CYCLES;
+		if(s_bInTick) s_nTickOverruns++;     // The last tick is still running.
+		else
+		{
+			bTick = True;
+			if(!s_bNestTick) RunTick();
+		}
+	}
+	Output(bTick && !s_bNestTick);
+	if(s_bHBridge) HBridgeStep();
+	if(s_bDither)
+	{
+		uint8_t a = s_iDitherAcc + s_iFrac;
+		OCR1B = s_iCount + (a < s_iDitherAcc);     // Carry out of the accumulator.
+		s_iDitherAcc = a;
+	}
+	if(bTick && s_bNestTick)
+	{
+		s_bInTick = True;
+		sei();
+		RunTick();
+		cli();
+		s_bInTick = False;
+		Output(True);
+	}
+}
+
+// Takes a new width from the mailbox, and, on a tick or with no ramp
+// limits, moves the output toward it.
+static void Output(bool8 bTick)
+{
+	if(s_bMailNew)
+	{
+		s_iWidth = s_Mail[s_iMailReady];
+		s_bMailNew = False;
+		s_iMailCycles = s_iCycles + s_iPeriod;
+	}
+	if(bTick || !(s_iAccel || s_iDecel))
+	{
+		int16_t v = (int16_t) s_iOutput - (NEUTRAL << 4);
+		int16_t target = (int16_t) s_iWidth - (NEUTRAL << 4);
+		if(v != target)
+		{
+			v = RampStep(v, target, ((v < 0) == (target < 0) && abs(target) > abs(v)) ? s_iAccel : s_iDecel);
+			s_iOutput = (NEUTRAL << 4) + v;
+			if(!s_bHBridge) SetCount(WidthToCount(s_iOutput));
+		}
+		if(v == target) s_iSettledCycles = s_iCycles;
+	}
+}
+
+// Runs the tick callback, and keeps its cost.  Without nesting, a tick
+// longer than a period may lose an overflow, so it is counted as an
+// overrun.
+static void RunTick()
+{
+	if(!s_pTickCallback) return;
+	uint32_t t0 = PWM_GetCycles();
+	s_pTickCallback();
+	uint32_t dt = PWM_GetCycles() - t0;
+	if(!s_bNestTick && dt >= s_iPeriod) s_nTickOverruns++;
+	if(dt > 0xFFFF) dt = 0xFFFF;
+	s_iTickCost = dt;
+	if(dt > s_iTickMaxCost) s_iTickMaxCost = dt;
+}
+
+// Runs the fast callback, and keeps its cost and jitter.
+static void RunFast()
+{
+	uint32_t t0 = PWM_GetCycles();
+	if(s_bFastPrimed)
+	{
+		int32_t jit = (int32_t) (t0 - s_iFastLast - s_nFastDiv * s_iPeriod);
+		if(jit < 0) jit = -jit;
+		if(jit > 0xFFFF) jit = 0xFFFF;
+		if((uint16_t) jit > s_iFastMaxJit) s_iFastMaxJit = jit;
+	}
+	s_iFastLast = t0;
+	s_bFastPrimed = True;
+	s_pFastCallback();
+	uint16_t dt = PWM_GetCycles() - t0;
+	s_iFastCost = dt;
+	if(dt > s_iFastMaxCost) s_iFastMaxCost = dt;
+}
+
+// Works out the periods per fast call, from the interval asked for,
+// rounded to the nearest, and at least one.
+static void FastDivider()
+{
+	uint32_t n = 1;
+	if(s_iPeriod) n = ((uint32_t) s_iFastUs * (F_CPU / 1000000) + s_iPeriod / 2) / s_iPeriod;
+	if(n < 1) n = 1;
+	s_nFastDiv = (n > 255) ? 255 : n;
+	s_iFastCount = s_nFastDiv;
+	s_bFastPrimed = False;
+}
+
+// Runs the H-bridge pins, once per period.  See the notes at the top.
+// Any change of state goes through HB_OFF, and the bridge must be off
+// for the dead time before it is driven again.
+static void HBridgeStep()
+{
+	int16_t v = (int16_t) s_iOutput - (NEUTRAL << 4);
+	uint8_t want = (v > 0) ? HB_FWD : (v < 0) ? HB_REV : (s_bHbBrake ? HB_BRAKE : HB_OFF);
+
+	if(s_iHbState == HB_OFF && s_iHbOff < s_nHbDead) s_iHbOff++;
+	if(want != s_iHbState)
+	{
+		if(s_iHbState != HB_OFF)
+		{
+			HB_ENOFF();
+			BitOff(PORTB, HbDirAPin);
+			BitOff(PORTB, HbDirBPin);
+			s_iHbState = HB_OFF;
+			s_iHbOff = 0;
+		}
+		if(want == HB_OFF || s_iHbOff < s_nHbDead) return;
+		if(want == HB_FWD) BitOn(PORTB, HbDirAPin);
+		if(want == HB_REV) BitOn(PORTB, HbDirBPin);
+		if(want == HB_BRAKE) SetCount((uint32_t) OCR1A << 16);   // Full on, with both direction pins low.
+		HB_ENPWM();
+		s_iHbState = want;
+	}
+	if(s_iHbState == HB_FWD || s_iHbState == HB_REV)
+	{
+		if(v < 0) v = -v;
+		SetCount((uint32_t) v * s_iMul);
+	}
+}
+
+// Works out the H-bridge dead time in periods, rounded up.
+static void HBridgeDeadTime()
+{
+	uint32_t n = 0;
+	if(s_iPeriod) n = ((uint32_t) s_iHbDeadUs * (F_CPU / 1000000) + s_iPeriod - 1) / s_iPeriod;
+	s_nHbDead = (n > 255) ? 255 : n;
+}
+
+// Moves v, an offset from neutral, one step toward target.  If the two
+// are on opposite sides of neutral, stops at neutral.
+static int16_t RampStep(int16_t v, int16_t target, int16_t limit)
+{
+	if((v > 0 && target < 0) || (v < 0 && target > 0)) target = 0;
+	if(limit == 0) return target;
+	if(target > v) return (target - v > limit) ? v + limit : target;
+	else           return (v - target > limit) ? v - limit : target;
+}
+
+// Converts a standard width, in 1/16 usecs, to a pulse count for the
+// running protocol, in 1/65536 counts.
+static uint32_t WidthToCount(uint16_t width)
+{
+	int32_t c = (int32_t) (width * s_iMul) + s_iAdd;
+	if(c < 0) return 0;
+	return (uint32_t) c;
+}
+
+// Sets the pulse count, given in 1/65536 counts.  With dithering off,
+// it is rounded and written to OCR1B.  With it on, the ISR writes OCR1B.
+static void SetCount(uint32_t c)
+{
+	s_iCount = c >> 16;
+	s_iFrac = c >> 8;
+	if(!s_bDither) OCR1B = (c + 32768) >> 16;
+}
+
+// Turns dithering of the pulse count on or off.
+void PWM_SetDither(bool8 bDither)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		s_bDither = bDither;
+		s_iDitherAcc = 0;
+		if(!bDither) OCR1B = s_iCount + (s_iFrac >= 128);
+	}
 }
 
 // PWM_Off() -- Turn off the PWM timmer, and set the output pin floating.
@@ -83,8 +729,14 @@ void PWM_Off()
 	   TCCR1A = 0;
 	   TCCR1B = 0;
 	   TCCR1C = 0;
+	   TIMSK1 = 0;
 
 		//Set output to be floating.
 	   BitOff(DDRD, PWMPin);
+	   if(s_bHBridge)
+	   {
+		   BitOff(PORTB, HbDirAPin);
+		   BitOff(PORTB, HbDirBPin);
+	   }
 	   s_bRunning = False;
 }
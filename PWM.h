@@ -9,9 +9,68 @@
 #ifndef PWM_H_
 #define PWM_H_
 
+#define PWM_TICKRATE 50         // Ramp and control ticks per second, for every protocol.
+
+// Output protocols.  See the table in PWM.c.
+#define PWM_SERVO50     0       // 50Hz servo, 1000-2000us.
+#define PWM_SERVO333    1       // 333Hz servo, 1000-2000us.
+#define PWM_SERVO490    2       // 490Hz servo, 1000-2000us.
+#define PWM_ONESHOT125  3       // 3KHz, 125-250us.
+#define PWM_ONESHOT42   4       // 8KHz, 41.7-83.3us.
+#define PWM_MULTISHOT   5       // 16KHz, 5-25us.
+#define PWM_HBRIDGE     6       // 20KHz, drives the SN754410 directly.  Duty is the offset from neutral.
+#define PWM_NPROTOCOLS  7
+
+EEu8(eePwmProtocol, PWM_SERVO50);   // Protocol used at power on.
+
+// H-bridge settings.
+EEu8(eeHbBrake, 0);             // 1 = brake at neutral, 0 = coast.
+EEu16(eeHbDead, 100);           // Dead time on a change of direction, in usecs.
+
+EEu8(eePwmDither, 0);           // 1 = dither the pulse count for sub-count resolution.
+
+// Ramp limits, in usecs per tick.  Zero means no limit.
+EEu16(eeRampAccel, 10);         // Away from neutral.
+EEu16(eeRampDecel, 20);         // Toward neutral.
+
+// Stats of the fast timer interrupt.  See EnableFastTimerInterrupt().
+typedef struct
+{
+	uint16_t Rate;              // Calls per second.  0 if off.
+	uint16_t Cost;              // CPU cycles taken by the last call,
+	uint16_t MaxCost;           // and the most taken.
+	uint16_t MaxJitter;         // Most the time between two calls was off the nominal, in CPU cycles.
+} PwmFastStats;
+
+// Stats of the tick callback.
+typedef struct
+{
+	uint16_t Cost;              // CPU cycles taken by the last tick callback,
+	uint16_t MaxCost;           // and the most taken.
+	uint16_t Overruns;          // Ticks that ran too long.
+	bool8 bNested;              // True if the tick runs with interrupts on.
+} PwmTickStats;
+
 void PWM_Init();
-void PWM_On(uint16_t freq, uint16_t width);
+void PWM_On(uint8_t iProtocol, uint16_t width);
 void PWM_SetWidth(uint16_t width);
+void PWM_SetWidthQ4(uint16_t width);
+uint16_t PWM_GetWidth();
+uint16_t PWM_GetWidthQ4();
+uint16_t PWM_GetCoalesced();
+uint32_t PWM_GetMailCycles();
+uint32_t PWM_GetSettledCycles();
+void PWM_SetRamp(uint16_t accel, uint16_t decel);
+void PWM_SetTickCallback(void (*pCallback)());
+void PWM_SetHBridge(bool8 bBrake, uint16_t deadUs);
+void PWM_SetDither(bool8 bDither);
+uint8_t PWM_GetProtocol();
+PGM_P PWM_ProtocolName(uint8_t iProtocol);
+uint32_t PWM_GetCycles();
+void PWM_GetFastStats(PwmFastStats *pStats);
+void PWM_ClearFastStats();
+void PWM_GetTickStats(PwmTickStats *pStats);
+void PWM_ClearTickStats();
 void PWM_Off();
 
 #endif /* PWM_H_ */
\ No newline at end of file
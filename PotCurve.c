@@ -0,0 +1,105 @@
+/*
+ * PotCurve.c
+ *
+ * Response curves for the pot.  The pot is only 10 bits, and mapping it
+ * straight onto the width gives a half usec per count, with no way to
+ * make fine changes near neutral.  A curve can add expo (a blend of a
+ * straight line and a cube), a deadband at zero (or a center detent, for
+ * a bipolar curve), and a limit on the maximum throw.
+ *
+ * The curves are worked out at compile time: the PC_xxx macros below are
+ * constant floating point expressions that the compiler reduces to a
+ * table of integers in PROGMEM, so no floating point code ends up in the
+ * program.  Each table has 65 points, one for every 16 pot counts, and
+ * the value between points is found by a straight line.  So each sample
+ * costs two table reads, a multiply and a shift.
+ *
+ * A unipolar curve gives an offset of 0 to CTL_MAXOFFSET, and the
+ * direction comes from the Dir button, as before.  A bipolar curve puts
+ * neutral at the center of the pot, and gives -CTL_MAXOFFSET to
+ * CTL_MAXOFFSET.
+ *
+ * Created: 10/18/2026
+ */
+
+#include "MainDef.h"
+#include "Control.h"
+#include "PotCurve.h"
+
+#define PC_NPOINTS 65               // Points in each table.
+#define PC_SHIFT   4                // Pot counts between points, as a power of two.
+
+// Builds point i of a curve.  bip: 1 for bipolar.  db: deadband, as a
+// fraction of the throw.  k: expo, from 0 (a line) to 1 (a cube).  m: max
+// throw, as a fraction of CTL_MAXOFFSET.
+#define PC_U(i, bip)          ((bip) ? (i) / 32.0 - 1.0 : (i) / 64.0)
+#define PC_A(i, bip)          (PC_U(i, bip) < 0 ? -PC_U(i, bip) : PC_U(i, bip))
+#define PC_D(i, bip, db)      (PC_A(i, bip) <= (db) ? 0.0 : (PC_A(i, bip) - (db)) / (1.0 - (db)))
+#define PC_Y(i, bip, db, k)   ((1.0 - (k)) * PC_D(i, bip, db) + (k) * PC_D(i, bip, db) * PC_D(i, bip, db) * PC_D(i, bip, db))
+#define PC_VAL(i, bip, db, k, m)  ((int16_t) ((PC_U(i, bip) < 0 ? -1 : 1) * (PC_Y(i, bip, db, k) * (m) * CTL_MAXOFFSET + 0.5)))
+
+#define PC_ROW8(i, bip, db, k, m) \
+	PC_VAL((i)+0, bip, db, k, m), PC_VAL((i)+1, bip, db, k, m), PC_VAL((i)+2, bip, db, k, m), PC_VAL((i)+3, bip, db, k, m), \
+	PC_VAL((i)+4, bip, db, k, m), PC_VAL((i)+5, bip, db, k, m), PC_VAL((i)+6, bip, db, k, m), PC_VAL((i)+7, bip, db, k, m)
+#define PC_TABLE(bip, db, k, m) \
+	{ PC_ROW8(0, bip, db, k, m),  PC_ROW8(8, bip, db, k, m),  PC_ROW8(16, bip, db, k, m), PC_ROW8(24, bip, db, k, m), \
+	  PC_ROW8(32, bip, db, k, m), PC_ROW8(40, bip, db, k, m), PC_ROW8(48, bip, db, k, m), PC_ROW8(56, bip, db, k, m), \
+	  PC_VAL(64, bip, db, k, m) }
+
+static const int16_t s_Curves[PC_NCURVES][PC_NPOINTS] PROGMEM =
+{
+	//       Bipolar  Deadband  Expo  Throw
+	PC_TABLE(0,       0.0,      0.0,  1.0),     // PC_LINEAR
+	PC_TABLE(0,       0.02,     0.5,  1.0),     // PC_EXPO
+	PC_TABLE(0,       0.02,     0.9,  1.0),     // PC_FINE
+	PC_TABLE(0,       0.0,      0.0,  0.5),     // PC_HALF
+	PC_TABLE(1,       0.06,     0.5,  1.0),     // PC_BIPOLAR
+};
+
+static const char s_sLinear[] PROGMEM = "Linear";
+static const char s_sExpo[] PROGMEM = "Expo";
+static const char s_sFine[] PROGMEM = "Fine";
+static const char s_sHalf[] PROGMEM = "Half";
+static const char s_sBipolar[] PROGMEM = "Bipolar";
+
+static PGM_P const s_Names[PC_NCURVES] PROGMEM =
+{
+	s_sLinear, s_sExpo, s_sFine, s_sHalf, s_sBipolar
+};
+
+static uint8_t s_iCurve = PC_LINEAR;   // Curve in use.
+
+// --------------------------------------------------------
+// PotCurve_Setup()
+// Loads the curve to use from EEPROM.
+void PotCurve_Setup()
+{
+	s_iCurve = eeprom_read_byte(&eePotCurve);
+	if(s_iCurve >= PC_NCURVES) s_iCurve = PC_LINEAR;
+}
+
+// --------------------------------------------------------
+// PotCurve_Shape()
+// Given a pot reading, 0 to 1023, returns the width offset from
+// neutral, in usecs.
+int16_t PotCurve_Shape(uint16_t pot)
+{
+	if(pot > 1023) pot = 1023;
+	const int16_t *p = &s_Curves[s_iCurve][pot >> PC_SHIFT];
+	int16_t a = pgm_read_word(p);
+	int16_t b = pgm_read_word(p + 1);
+	return a + (((b - a) * (int16_t) (pot & ((1 << PC_SHIFT) - 1))) >> PC_SHIFT);
+}
+
+// Returns True if the curve in use puts neutral at the center of the pot.
+uint8_t PotCurve_IsBipolar()
+{
+	return s_iCurve == PC_BIPOLAR;
+}
+
+// Returns the name of a curve, in PROGMEM.
+PGM_P PotCurve_Name(uint8_t iCurve)
+{
+	if(iCurve >= PC_NCURVES) iCurve = PC_LINEAR;
+	return (PGM_P) pgm_read_word(&s_Names[iCurve]);
+}
@@ -0,0 +1,29 @@
+/*
+ * PotCurve.h
+ *
+ * Response curves that map the pot onto a width offset from neutral.
+ *
+ * Created: 10/18/2026
+ */
+
+#ifndef POTCURVE_H_
+#define POTCURVE_H_
+
+#include "MainDef.h"
+
+// The curves.  See the table in PotCurve.c.
+#define PC_LINEAR    0      // Straight line, the same as the original pot response.
+#define PC_EXPO      1      // Mild expo, with a small deadband at zero.
+#define PC_FINE      2      // Strong expo, for fine control near neutral.
+#define PC_HALF      3      // Linear, limited to half throw.
+#define PC_BIPOLAR   4      // Center of the pot is neutral, with a detent and mild expo.
+#define PC_NCURVES   5
+
+EEu8(eePotCurve, PC_LINEAR);    // Curve used in run mode.
+
+void PotCurve_Setup();
+int16_t PotCurve_Shape(uint16_t pot);
+uint8_t PotCurve_IsBipolar();
+PGM_P PotCurve_Name(uint8_t iCurve);
+
+#endif /* POTCURVE_H_ */
@@ -0,0 +1,327 @@
+/*
+ * Profile.c
+ *
+ * Keyframe test profiles.  A profile is a list of keyframes (step, hold,
+ * or ramp, each with a duration) that is played in the background by
+ * Profile_Tick(), which runs once per PWM tick from Control_Tick().
+ * A profile can be looped any number of times, and is stopped at once
+ * if a fault is latched.
+ *
+ * The built in profiles are in PROGMEM.  One more, the "user" profile,
+ * is kept in EEPROM so it can be changed without building new code.
+ *
+ * Ramps are done with a DDA: the whole and fractional parts of the
+ * step per tick are found once, when the keyframe is loaded.  After
+ * that, each tick is just adds and compares -- no division.
+ *
+ * In width profiles, each tick's value goes through Control_Output(), so
+ * the stall throttle, the thermal derate and the battery correction
+ * apply, as in the Run mode.  In current profiles, the current loop
+ * (CurCtl.c) is run with a fixed setpoint taken from the profile, and it
+ * applies them to its own output.
+ *
+ * Created: 10/18/2026
+ */
+
+#include "MainDef.h"
+#include "PWM.h"
+#include "Control.h"
+#include "CurCtl.h"
+#include "Profile.h"
+#include <string.h>
+
+typedef struct
+{
+	PGM_P pName;               // Name of the profile.
+	const PrfKey *pKeys;       // The keyframes, in PROGMEM.  NULL for the EEPROM profile.
+	uint8_t Mode;              // PRF_WIDTH or PRF_CURRENT.
+} PrfInfo;
+
+// Width steps, up and back down, forward only.
+static const PROGMEM PrfKey s_Steps[] =
+{
+	{PRF_STEP,  100, 100},
+	{PRF_STEP,  200, 100},
+	{PRF_STEP,  300, 100},
+	{PRF_STEP,  400, 100},
+	{PRF_STEP,    0,  50},
+	{PRF_END,     0,   0},
+};
+
+// Slow ramps to full forward and full reverse.
+static const PROGMEM PrfKey s_Ramps[] =
+{
+	{PRF_RAMP,  500, 250},
+	{PRF_HOLD,    0, 100},
+	{PRF_RAMP,    0, 250},
+	{PRF_HOLD,    0,  50},
+	{PRF_RAMP, -500, 250},
+	{PRF_HOLD,    0, 100},
+	{PRF_RAMP,    0, 250},
+	{PRF_HOLD,    0,  50},
+	{PRF_END,     0,   0},
+};
+
+// Current steps, for torque testing.
+static const PROGMEM PrfKey s_Torque[] =
+{
+	{PRF_STEP,  500, 100},
+	{PRF_STEP, 1000, 100},
+	{PRF_STEP, 2000, 100},
+	{PRF_RAMP,    0, 100},
+	{PRF_HOLD,    0,  50},
+	{PRF_END,     0,   0},
+};
+
+// The user profile, in EEPROM.  Starts out as a single step.
+static EEMEM PrfKey eeUserProfile[PRF_NUSERKEYS] =
+{
+	{PRF_STEP,  100, 250},
+	{PRF_STEP,    0,  50},
+	{PRF_END,     0,   0},
+};
+
+static const char s_sSteps[] PROGMEM = "Steps";
+static const char s_sRamps[] PROGMEM = "Ramps";
+static const char s_sTorque[] PROGMEM = "Torque";
+static const char s_sUser[] PROGMEM = "User";
+
+static const PROGMEM PrfInfo s_Profiles[] =
+{
+	{s_sSteps,  s_Steps,  PRF_WIDTH},
+	{s_sRamps,  s_Ramps,  PRF_WIDTH},
+	{s_sTorque, s_Torque, PRF_CURRENT},
+	{s_sUser,   NULL,     PRF_WIDTH},
+};
+#define NPROFILES (sizeof(s_Profiles) / sizeof(PrfInfo))
+
+static volatile uint8_t s_iState = PRF_IDLE;
+static const PrfKey *s_pKeys = NULL;   // Keyframes of the running profile.  NULL for EEPROM.
+static uint8_t  s_iMode = PRF_WIDTH;
+static uint8_t  s_nLoops = 1;          // Number of times to play the profile.
+static volatile uint8_t s_iLoop = 0;   // Current pass through the profile.
+static volatile uint8_t s_iKey = 0;    // Index of the current keyframe.
+static PrfKey   s_Key;                 // Copy of the current keyframe.
+static uint16_t s_iLeft = 0;           // Ticks left in the current keyframe.
+static int16_t  s_iValue = 0;          // Value being output.
+static int16_t  s_iStep = 0;           // Ramp: whole part of the step per tick.
+static uint16_t s_iFrac = 0;           // Ramp: fractional part of the step, in 1/Ticks.
+static uint16_t s_iAcc = 0;            // Ramp: fraction accumulator, in 1/Ticks.
+static int8_t   s_iSign = 1;           // Ramp: direction of the fractional step.
+static bool8    s_bForward = True;     // Current profiles: direction given to the current loop.
+static volatile uint16_t s_iElapsed = 0;  // Ticks played in this pass.
+static uint16_t s_iTotal = 1;          // Ticks in one pass.
+
+static void LoadKey(uint8_t i, PrfKey *pKey);
+static bool8 NextKey();
+static void Output(int16_t v);
+static void Finish(uint8_t state);
+
+// --------------------------------------------------------
+// Profile_Count()
+// Returns the number of profiles.
+uint8_t Profile_Count()
+{
+	return NPROFILES;
+}
+
+// --------------------------------------------------------
+// Profile_Name()
+// Returns the name of a profile, in PROGMEM.
+PGM_P Profile_Name(uint8_t iProfile)
+{
+	if(iProfile >= NPROFILES) return NULL;
+	return (PGM_P) pgm_read_word(&s_Profiles[iProfile].pName);
+}
+
+// --------------------------------------------------------
+// Profile_Start()
+// Starts playing a profile nLoops times.  The motor relay
+// must already be closed.  Returns False if the profile is
+// empty, or there is a fault.
+bool8 Profile_Start(uint8_t iProfile, uint8_t nLoops)
+{
+	if(iProfile >= NPROFILES || Control_GetFault()) return False;
+	Profile_Stop();
+
+	s_pKeys = (const PrfKey *) pgm_read_word(&s_Profiles[iProfile].pKeys);
+	s_iMode = pgm_read_byte(&s_Profiles[iProfile].Mode);
+	if(!s_pKeys) s_iMode = eeprom_read_byte(&eeUserPrfMode);
+
+	// Find the length of one pass, for the progress display.
+	uint32_t total = 0;
+	PrfKey k;
+	for(uint8_t i = 0; i < 255; i++)
+	{
+		LoadKey(i, &k);
+		if(k.Type == PRF_END) break;
+		total += k.Ticks;
+	}
+	if(total == 0) return False;
+	s_iTotal = (total > 65535) ? 65535 : total;
+
+	s_nLoops = nLoops ? nLoops : 1;
+	s_iLoop = 0;
+	s_iKey = 0;
+	s_iLeft = 0;
+	s_iValue = 0;
+	s_iElapsed = 0;
+	s_Key.Type = PRF_END;
+	if(s_iMode == PRF_CURRENT)
+	{
+		s_bForward = True;
+		CurCtl_SetSetpoint(0);
+		CurCtl_Start(True);
+	}
+	s_iState = PRF_RUNNING;
+	return True;
+}
+
+// --------------------------------------------------------
+// Profile_Stop()
+// Stops the profile, and returns the output to neutral.
+void Profile_Stop()
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		if(s_iState == PRF_RUNNING) Finish(PRF_ABORTED);
+	}
+}
+
+// --------------------------------------------------------
+// Profile_Tick()
+// Plays one tick of the profile.  Called once per PWM tick,
+// from the Timer1 overflow interrupt.
+void Profile_Tick()
+{
+	if(s_iState != PRF_RUNNING) return;
+	if(Control_GetFault())
+	{
+		Finish(PRF_ABORTED);
+		return;
+	}
+	if(s_iLeft == 0 && !NextKey())
+	{
+		Finish(PRF_DONE);
+		return;
+	}
+	if(s_Key.Type == PRF_RAMP)
+	{
+		s_iValue += s_iStep;
+		s_iAcc += s_iFrac;
+		if(s_iAcc >= s_Key.Ticks)
+		{
+			s_iAcc -= s_Key.Ticks;
+			s_iValue += s_iSign;
+		}
+	}
+	Output(s_iValue);
+	s_iLeft--;
+	s_iElapsed++;
+}
+
+// Moves to the next keyframe, starting the next pass if needed.
+// Returns False when the profile is finished.
+static bool8 NextKey()
+{
+	if(s_Key.Type != PRF_END) s_iKey++;
+	LoadKey(s_iKey, &s_Key);
+	if(s_Key.Type == PRF_END)
+	{
+		if(++s_iLoop >= s_nLoops) return False;
+		s_iKey = 0;
+		s_iElapsed = 0;
+		LoadKey(0, &s_Key);
+	}
+	if(s_Key.Ticks == 0) s_Key.Ticks = 1;
+	s_iLeft = s_Key.Ticks;
+	if(s_Key.Type == PRF_STEP) s_iValue = s_Key.Value;
+	if(s_Key.Type == PRF_RAMP)
+	{
+		// The only division in the ramp: once per keyframe.
+		int16_t d = s_Key.Value - s_iValue;
+		s_iStep = d / (int16_t) s_Key.Ticks;
+		int16_t r = d - s_iStep * (int16_t) s_Key.Ticks;
+		s_iSign = (r < 0) ? -1 : 1;
+		s_iFrac = (r < 0) ? -r : r;
+		s_iAcc = 0;
+	}
+	return True;
+}
+
+// Copies keyframe i of the running profile into pKey.
+static void LoadKey(uint8_t i, PrfKey *pKey)
+{
+	if(s_pKeys) memcpy_P(pKey, s_pKeys + i, sizeof(PrfKey));
+	else if(i < PRF_NUSERKEYS) eeprom_read_block(pKey, &eeUserProfile[i], sizeof(PrfKey));
+	else pKey->Type = PRF_END;
+}
+
+// Sends a value to the output.
+static void Output(int16_t v)
+{
+	if(s_iMode == PRF_CURRENT)
+	{
+		bool8 forward = (v >= 0);
+		if(forward != s_bForward)
+		{
+			s_bForward = forward;
+			CurCtl_SetForward(forward);
+		}
+		CurCtl_SetSetpoint(forward ? v : -v);
+	}
+	else
+	{
+		if(v > CTL_MAXOFFSET) v = CTL_MAXOFFSET;
+		if(v < -CTL_MAXOFFSET) v = -CTL_MAXOFFSET;
+		PWM_SetWidth(CTL_NEUTRAL + Control_Output(v));
+	}
+}
+
+// Ends the profile, and returns the output to neutral.
+static void Finish(uint8_t state)
+{
+	if(s_iMode == PRF_CURRENT)
+	{
+		CurCtl_Stop();
+		CurCtl_SetSetpoint(-1);
+	}
+	PWM_SetWidth(CTL_NEUTRAL);
+	s_iState = state;
+}
+
+// --------------------------------------------------------
+// Profile_GetState()
+// Returns PRF_IDLE, PRF_RUNNING, PRF_DONE or PRF_ABORTED.
+uint8_t Profile_GetState()
+{
+	return s_iState;
+}
+
+// Returns the index of the current keyframe.
+uint8_t Profile_GetKey()
+{
+	return s_iKey;
+}
+
+// Returns the current pass through the profile, starting at zero.
+uint8_t Profile_GetLoop()
+{
+	return s_iLoop;
+}
+
+// Returns how far through the current pass the profile is, in percent.
+uint8_t Profile_GetPercent()
+{
+	uint16_t e;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { e = s_iElapsed; }
+	return (uint8_t) (((uint32_t) e * 100) / s_iTotal);
+}
+
+// Returns the value being output.
+int16_t Profile_GetValue()
+{
+	int16_t v;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { v = s_iValue; }
+	return v;
+}
@@ -0,0 +1,52 @@
+/*
+ * Profile.h
+ *
+ * Keyframe test profiles, played in the background.
+ *
+ * Created: 10/18/2026
+ */ 
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include "MainDef.h"
+
+// Keyframe types.
+#define PRF_END     0      // End of the profile.
+#define PRF_STEP    1      // Jump to Value, and hold it for Ticks.
+#define PRF_HOLD    2      // Hold the last value for Ticks.  Value is ignored.
+#define PRF_RAMP    3      // Move in a straight line from the last value to Value, over Ticks.
+
+// What the values in a profile command.
+#define PRF_WIDTH   0      // Width offset from neutral, in usecs.  The sign is the direction.
+#define PRF_CURRENT 1      // Current, in 100th of Amps.  The sign is the direction.
+
+// Profile states.
+#define PRF_IDLE    0
+#define PRF_RUNNING 1
+#define PRF_DONE    2
+#define PRF_ABORTED 3
+
+#define PRF_NUSERKEYS 8    // Keyframes in the EEPROM profile.
+
+typedef struct
+{
+	uint8_t  Type;         // PRF_xxx keyframe type.
+	int16_t  Value;        // Target value.  See PRF_WIDTH and PRF_CURRENT.
+	uint16_t Ticks;        // Duration, in PWM ticks (PWM_TICKRATE per second).
+} PrfKey;
+
+EEu8(eeUserPrfMode, PRF_WIDTH);   // What the EEPROM profile commands.
+
+uint8_t Profile_Count();
+PGM_P Profile_Name(uint8_t iProfile);
+bool8 Profile_Start(uint8_t iProfile, uint8_t nLoops);
+void Profile_Stop();
+void Profile_Tick();
+uint8_t Profile_GetState();
+uint8_t Profile_GetKey();
+uint8_t Profile_GetLoop();
+uint8_t Profile_GetPercent();
+int16_t Profile_GetValue();
+
+#endif /* PROFILE_H_ */
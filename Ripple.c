@@ -0,0 +1,268 @@
+/*
+ * Ripple.c
+ *
+ * Sensorless speed for a brushed motor.  Each time a brush crosses from
+ * one commutator segment to the next, the current dips, so the current
+ * carries a ripple at segments * RPM / 60 Hz.  A burst of RIP_N samples
+ * of the current sense is taken at ADC_BURSTRATE (see ADC_StartBurst()),
+ * and a bank of Goertzel filters, one on each bin of a RIP_N point DFT,
+ * finds the strongest ripple.  The bins are 47Hz apart, and the peak is
+ * placed between them by fitting a parabola to it and its neighbours.
+ * With 8 segments, bins 2 to 62 cover about 700 to 21000 RPM.
+ *
+ * Goertzel, for bin k, with c = 2cos(2 pi k / N):
+ *
+ *     s[n] = x[n] + c * s[n-1] - s[n-2]
+ *     power = s1^2 + s2^2 - c * s1 * s2     (s1, s2: the last two s)
+ *
+ * All fixed point.  The samples are in 1/16 counts less their mean, c is
+ * Q14, and s is 32 bits.  Since |s| is at most sum|x| / sin(2 pi k / N),
+ * a shift for the whole burst is found from the biggest sample, that
+ * brings s to 15 bits for the power, so the powers of all the bins can
+ * be compared.
+ *
+ * It all runs from Ripple_Poll(), called between UI frames: one step per
+ * call, which is starting a burst, or the filter for one bin (about 1ms).
+ * The cycles taken by the analysis of each burst, and by the longest
+ * step, are kept.
+ *
+ * Created: 10/18/2026
+ */
+
+#include "MainDef.h"
+#include "ADC.h"
+#include "PWM.h"
+#include "Ripple.h"
+
+#define RIP_KMIN     2                  // Bins searched.
+#define RIP_KMAX     (RIP_N/2 - 2)
+#define RIP_SINMIN   11                 // More than 1 / sin(2 pi k / RIP_N), for all the bins searched.
+#define RIP_SMAX     30000              // Largest s for the power, after the shift.
+#define RIP_SNR      8                  // The peak must be this many times the average power.
+#define RIP_RPMK     ((uint32_t) (ADC_BURSTRATE * 60.0 / RIP_N + 0.5))  // RPM * segments per bin.
+
+// States.
+#define RIP_OFF      0
+#define RIP_START    1          // Starting a burst.
+#define RIP_CAPTURE  2          // Waiting for the burst.
+#define RIP_BINS     3          // Running the filters, one bin per step.
+
+// c = 2cos(2 pi k / N) in Q14, for the bins, worked out at compile time.
+#define RIP_C(k)     ((int16_t) (32768.0 * __builtin_cos(6.283185307179586 * (k) / RIP_N) + ((k) < RIP_N/4 ? 0.5 : -0.5)))
+#define RIP_C8(k)    RIP_C((k)+0), RIP_C((k)+1), RIP_C((k)+2), RIP_C((k)+3), RIP_C((k)+4), RIP_C((k)+5), RIP_C((k)+6), RIP_C((k)+7)
+
+static const int16_t s_Coeff[RIP_N/2] PROGMEM =
+{
+	32767,      RIP_C(1),   RIP_C(2),   RIP_C(3),   RIP_C(4),   RIP_C(5),   RIP_C(6),   RIP_C(7),
+	RIP_C8(8),  RIP_C8(16), RIP_C8(24), RIP_C8(32), RIP_C8(40), RIP_C8(48), RIP_C8(56)
+};
+
+static int8_t s_Buf[RIP_N];             // The burst.
+static uint8_t s_iState = RIP_OFF;
+static uint8_t s_nSegs = 1;
+static int16_t s_iMean = 0;             // Mean of the burst, in 1/16 counts.
+static uint8_t s_iShift = 0;            // Shift that brings s to RIP_SMAX.
+static uint8_t s_iBin = 0;              // Bin to run next.
+static uint32_t s_iPrev = 0;            // Power of the last bin.
+static uint32_t s_iSum = 0;             // Sum of the powers, / 64.
+static uint32_t s_iPeak = 0;            // Power of the peak bin,
+static uint32_t s_iPeakM1 = 0;          // and of the bins each side of it.
+static uint32_t s_iPeakP1 = 0;
+static uint8_t s_iPeakBin = 0;
+static uint32_t s_iCalc = 0;            // Cycles so far, for this burst.
+static volatile int16_t s_iRpm = 0;
+static volatile uint8_t s_iLastPeak = 0;
+static volatile uint32_t s_iCalcLast = 0;
+static volatile uint16_t s_iSliceMax = 0;
+
+static void Prepare();
+static uint32_t Bin(uint8_t k);
+static void Finish();
+static int32_t MulQ14(int32_t s, int16_t c);
+
+// --------------------------------------------------------
+// Ripple_Setup()
+// Loads the settings from EEPROM, and starts measuring.
+void Ripple_Setup()
+{
+	s_nSegs = eeprom_read_byte(&eeRippleSegs);
+	if(s_nSegs == 0) s_nSegs = 1;
+	s_iRpm = 0;
+	s_iSliceMax = 0;
+	s_iState = RIP_START;
+}
+
+// Stops measuring.  A burst already running finishes by itself.
+void Ripple_Stop()
+{
+	s_iState = RIP_OFF;
+	s_iRpm = 0;
+}
+
+// --------------------------------------------------------
+// Ripple_Poll()
+// Does one step of the measurement.  Call between UI frames.
+void Ripple_Poll()
+{
+	if(s_iState == RIP_OFF) return;
+	uint32_t t0 = PWM_GetCycles();
+	switch(s_iState)
+	{
+		case RIP_START:
+			// Refused while there is a frame callback (the current
+			// loop or a sweep), so just try again next time.
+			if(ADC_StartBurst(s_Buf, RIP_N)) s_iState = RIP_CAPTURE;
+			return;
+		case RIP_CAPTURE:
+			if(!ADC_IsBurstDone()) return;
+			s_iCalc = 0;
+			Prepare();
+			s_iState = RIP_BINS;
+			break;
+		case RIP_BINS:
+		{
+			uint32_t p = Bin(s_iBin);
+			s_iSum += p >> 6;
+			if(p > s_iPeak)
+			{
+				s_iPeak = p;
+				s_iPeakBin = s_iBin;
+				s_iPeakM1 = s_iPrev;
+				s_iPeakP1 = 0;
+			}
+			else if(s_iBin == s_iPeakBin + 1) s_iPeakP1 = p;
+			s_iPrev = p;
+			if(++s_iBin > RIP_KMAX)
+			{
+				Finish();
+				s_iState = RIP_START;
+			}
+			break;
+		}
+	}
+	uint16_t dt = PWM_GetCycles() - t0;
+	if(dt > s_iSliceMax) s_iSliceMax = dt;
+	s_iCalc += dt;
+	if(s_iState == RIP_START) s_iCalcLast = s_iCalc;
+}
+
+// Finds the mean and the shift for the burst, and sets up the search.
+static void Prepare()
+{
+	int16_t sum = 0;
+	for(uint8_t i = 0; i < RIP_N; i++) sum += s_Buf[i];
+	s_iMean = sum / (RIP_N / 16);
+	uint16_t most = 0;
+	for(uint8_t i = 0; i < RIP_N; i++)
+	{
+		int16_t x = ((int16_t) s_Buf[i] << 4) - s_iMean;
+		if(x < 0) x = -x;
+		if(x > most) most = x;
+	}
+	uint32_t bound = (uint32_t) most * RIP_N * RIP_SINMIN;
+	s_iShift = 0;
+	while((bound >> s_iShift) > RIP_SMAX) s_iShift++;
+	s_iBin = RIP_KMIN;
+	s_iPrev = 0;
+	s_iSum = 0;
+	s_iPeak = 0;
+	s_iPeakBin = 0;
+}
+
+// Runs the Goertzel filter for bin k over the burst, and returns the
+// power, after the shift.
+static uint32_t Bin(uint8_t k)
+{
+	int16_t c = pgm_read_word(&s_Coeff[k]);
+	int32_t s1 = 0;
+	int32_t s2 = 0;
+	for(uint8_t i = 0; i < RIP_N; i++)
+	{
+		int16_t x = ((int16_t) s_Buf[i] << 4) - s_iMean;
+		int32_t s0 = x + MulQ14(s1, c) - s2;
+		s2 = s1;
+		s1 = s0;
+	}
+	s1 >>= s_iShift;
+	s2 >>= s_iShift;
+	// Each term fits in 32 bits, and so does the power, but not the
+	// middle of the sum, so it is done unsigned.
+	uint32_t cs1 = (uint32_t) MulQ14(s1, c);
+	return (uint32_t) (s1 * s1) + (uint32_t) (s2 * s2) - cs1 * (uint32_t) s2;
+}
+
+// Finds the speed from the peak.
+static void Finish()
+{
+	uint8_t nBins = RIP_KMAX - RIP_KMIN + 1;
+	if(s_iPeak == 0 || (s_iPeak >> 6) < (s_iSum / nBins) * RIP_SNR)
+	{
+		// No clear ripple.
+		s_iRpm = 0;
+		s_iLastPeak = 0;
+		return;
+	}
+
+	// Parabola through the peak and its neighbours, on powers scaled
+	// to 22 bits: offset = (a - c) / (2 (a - 2b + c)), in 1/256 bins.
+	int16_t frac = 0;
+	if(s_iPeakBin > RIP_KMIN && s_iPeakBin < RIP_KMAX)
+	{
+		uint8_t sh = 0;
+		while((s_iPeak >> sh) >= (1UL << 22)) sh++;
+		int32_t a = s_iPeakM1 >> sh;
+		int32_t b = s_iPeak >> sh;
+		int32_t cc = s_iPeakP1 >> sh;
+		int32_t den = a - 2 * b + cc;
+		if(den < 0)
+		{
+			int32_t f = ((a - cc) * 128) / den;
+			if(f > 128) f = 128;
+			if(f < -128) f = -128;
+			frac = f;
+		}
+	}
+	uint16_t bins = ((uint16_t) s_iPeakBin << 8) + frac;
+	uint32_t rpm = (((uint32_t) bins * RIP_RPMK) >> 8) / s_nSegs;
+	if(rpm > 32767) rpm = 32767;
+	s_iRpm = rpm;
+	s_iLastPeak = s_iPeakBin;
+}
+
+// Returns s * c, with c in Q14.  s must be under 2^29, and is split in
+// two, so that only 16 x 16 bit multiplies are needed.
+static int32_t MulQ14(int32_t s, int16_t c)
+{
+	int16_t hi = s >> 16;
+	uint16_t lo = s;
+	return ((int32_t) hi * c) * 4 + (((int32_t) lo * c) >> 14);
+}
+
+// Returns the speed, in RPM, from the last burst.  0 if there
+// was no clear ripple.
+int16_t Ripple_GetRpm()
+{
+	int16_t v;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { v = s_iRpm; }
+	return v;
+}
+
+// Returns the bin of the last peak found.  0 if none.
+uint8_t Ripple_GetPeak()
+{
+	return s_iLastPeak;
+}
+
+// Returns the CPU cycles taken to analyse the last burst.
+uint32_t Ripple_GetCalcCycles()
+{
+	uint32_t v;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { v = s_iCalcLast; }
+	return v;
+}
+
+// Returns the most CPU cycles taken by one call of Ripple_Poll().
+uint16_t Ripple_GetSliceCycles()
+{
+	return s_iSliceMax;
+}
@@ -0,0 +1,27 @@
+/*
+ * Ripple.h
+ *
+ * Sensorless speed, from the commutation ripple in the current of a
+ * brushed motor.
+ *
+ * Created: 10/18/2026
+ */
+
+#ifndef RIPPLE_H_
+#define RIPPLE_H_
+
+#include "MainDef.h"
+
+#define RIP_N        128        // Samples per burst.
+
+EEu8(eeRippleSegs, 8);          // Commutator segments: current ripples per rev.
+
+void Ripple_Setup();
+void Ripple_Stop();
+void Ripple_Poll();
+int16_t Ripple_GetRpm();
+uint8_t Ripple_GetPeak();
+uint32_t Ripple_GetCalcCycles();
+uint16_t Ripple_GetSliceCycles();
+
+#endif /* RIPPLE_H_ */
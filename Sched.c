@@ -0,0 +1,243 @@
+/*
+ * Sched.c
+ *
+ * Timers, run from the system clock tick (the Timer0 interrupt, every
+ * 20.07ms, see SysClock.c).  Up to SCHED_NTIMERS at once, each one-shot
+ * or periodic, with the delay and period in msecs, rounded up to ticks.
+ *
+ * The timers are kept in a small timer wheel: SCHED_NSLOTS lists, by the
+ * low bits of the tick each timer is due on.  Each tick only walks the
+ * one list for that tick, and fires the timers in it that are due on
+ * this tick (those due a turn of the wheel later are passed over).  A
+ * periodic timer is put back in the wheel at its next due tick.  So the
+ * work per tick doesn't grow with the number of timers, only with how
+ * many share a slot.  The lists are linked by index, to save RAM.
+ *
+ * A callback is run one of two ways:
+ *
+ *     SCHED_ISR:    In the tick interrupt, after the wheel is walked, with
+ *                   interrupts still off.  So it doesn't nest, but it
+ *                   holds off every other interrupt (the PWM, the ADC),
+ *                   and must be short.
+ *     SCHED_DEFER:  The tick only marks it as fired, and Sched_Poll(),
+ *                   in the main loop, runs it.  Sched_Poll() is called by
+ *                   UI_GetButtons(), which every screen loop calls.
+ *
+ * For diagnostics: a deferred timer that fires again before its last
+ * firing has run is an overrun (the firing is dropped), and one that runs
+ * more than SCHED_SLACK ticks after it was due is a miss.  The most it
+ * was late, and the most cycles a tick has taken, are kept too.
+ *
+ * Created: 10/18/2026
+ */
+
+#include "MainDef.h"
+#include "SysClock.h"
+#include "PWM.h"
+#include "Sched.h"
+
+#define SCHED_NSLOTS   8                // Slots in the wheel.  A power of 2.
+#define SCHED_SLACK    5                // Ticks a deferred callback may be late (100ms).
+#define SCHED_TICKQ16  ((uint32_t) (65536.0 * F_CPU / (1000.0 * SYS_T0CYCLES) + 0.5))   // Ticks per msec, in 1/65536ths.
+
+// State bits, kept with the flags.
+#define SF_LINKED      0x80             // In the wheel.
+#define SF_PENDING     0x40             // Deferred, fired, and not yet run.
+
+typedef struct
+{
+	void (*pCallback)();       // NULL if the timer is free.
+	uint16_t Due;              // Tick it fires on.
+	uint16_t Period;           // Ticks between firings.  0 = one-shot.
+	uint16_t PendDue;          // Deferred: tick the waiting firing was due on.
+	uint8_t Flags;             // SCHED_xxx, and the SF_xxx state bits.
+	uint8_t Next;              // Next timer in the slot, or SCHED_NONE.
+} SchedTimer;
+
+static SchedTimer s_Timers[SCHED_NTIMERS];
+static uint8_t s_Slot[SCHED_NSLOTS] = {SCHED_NONE, SCHED_NONE, SCHED_NONE, SCHED_NONE,
+                                       SCHED_NONE, SCHED_NONE, SCHED_NONE, SCHED_NONE};
+static volatile uint16_t s_iNow = 0;            // Ticks so far.
+static bool8 s_bPolling = False;                // True while Sched_Poll() runs a callback.
+static volatile uint16_t s_iOverruns = 0;
+static uint16_t s_iMisses = 0;
+static uint16_t s_iMaxLate = 0;                 // In ticks.
+static volatile uint16_t s_iMaxTickCycles = 0;
+
+static void Link(uint8_t i);
+static void Unlink(uint8_t i);
+static uint16_t Ticks(uint16_t ms);
+
+// --------------------------------------------------------
+// Sched_Add()
+// Starts a timer that calls pCallback in delay msecs, and then, if
+// period is not zero, every period msecs.  flags is SCHED_ISR or
+// SCHED_DEFER.  Returns the timer's id, for Sched_Cancel(), or
+// SCHED_NONE if all the timers are in use.
+uint8_t Sched_Add(void (*pCallback)(), uint16_t delay, uint16_t period, uint8_t flags)
+{
+	uint8_t id = SCHED_NONE;
+	uint16_t d = Ticks(delay);
+	uint16_t p = period ? Ticks(period) : 0;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		for(uint8_t i = 0; i < SCHED_NTIMERS; i++)
+		{
+			if(s_Timers[i].pCallback) continue;
+			SchedTimer *pT = &s_Timers[i];
+			pT->pCallback = pCallback;
+			pT->Due = s_iNow + d;
+			pT->Period = p;
+			pT->Flags = flags & SCHED_ISR;
+			Link(i);
+			id = i;
+			break;
+		}
+	}
+	return id;
+}
+
+// Stops a timer, and frees it.  A deferred firing not yet run is
+// dropped.
+void Sched_Cancel(uint8_t id)
+{
+	if(id >= SCHED_NTIMERS) return;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		if(s_Timers[id].Flags & SF_LINKED) Unlink(id);
+		s_Timers[id].Flags = 0;
+		s_Timers[id].pCallback = NULL;
+	}
+}
+
+// --------------------------------------------------------
+// Sched_Tick()
+// Advances the wheel by one tick, and fires the timers due.  Called
+// from the Timer0 interrupt, with interrupts off.
+void Sched_Tick()
+{
+	uint32_t t0 = PWM_GetCycles();
+	void (*calls[SCHED_NTIMERS])();
+	uint8_t nCalls = 0;
+	uint16_t now = ++s_iNow;
+	uint8_t *pLink = &s_Slot[now & (SCHED_NSLOTS - 1)];
+	while(*pLink != SCHED_NONE)
+	{
+		uint8_t i = *pLink;
+		SchedTimer *pT = &s_Timers[i];
+		if(pT->Due != now)
+		{
+			pLink = &pT->Next;
+			continue;
+		}
+		*pLink = pT->Next;
+		pT->Flags &= ~SF_LINKED;
+		if(pT->Flags & SCHED_ISR) calls[nCalls++] = pT->pCallback;
+		else if(pT->Flags & SF_PENDING) s_iOverruns++;
+		else
+		{
+			pT->Flags |= SF_PENDING;
+			pT->PendDue = now;
+		}
+		if(pT->Period)
+		{
+			// Back in the wheel.  If it goes in this slot, it goes at the
+			// head, which the walk has passed, or is not due this tick.
+			pT->Due = now + pT->Period;
+			Link(i);
+		}
+		else if(!(pT->Flags & SF_PENDING)) pT->pCallback = NULL;
+	}
+	// Called after the walk, so that they can add and cancel timers.
+	for(uint8_t i = 0; i < nCalls; i++) calls[i]();
+	uint16_t dt = PWM_GetCycles() - t0;
+	if(dt > s_iMaxTickCycles) s_iMaxTickCycles = dt;
+}
+
+// --------------------------------------------------------
+// Sched_Poll()
+// Runs the deferred callbacks that have fired.  Call from the main
+// loop.  A callback that itself calls Sched_Poll() (say, through
+// UI_GetButtons()) doesn't run the others from inside it.
+void Sched_Poll()
+{
+	if(s_bPolling) return;
+	s_bPolling = True;
+	for(uint8_t i = 0; i < SCHED_NTIMERS; i++)
+	{
+		void (*pCallback)() = NULL;
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			SchedTimer *pT = &s_Timers[i];
+			if(pT->Flags & SF_PENDING)
+			{
+				pCallback = pT->pCallback;
+				pT->Flags &= ~SF_PENDING;
+				uint16_t late = s_iNow - pT->PendDue;
+				if(late > s_iMaxLate) s_iMaxLate = late;
+				if(late > SCHED_SLACK) s_iMisses++;
+				if(!(pT->Flags & SF_LINKED)) pT->pCallback = NULL;     // One-shot, done.
+			}
+		}
+		if(pCallback) pCallback();
+	}
+	s_bPolling = False;
+}
+
+// Puts a timer at the head of the slot for its due tick.
+static void Link(uint8_t i)
+{
+	uint8_t *pHead = &s_Slot[s_Timers[i].Due & (SCHED_NSLOTS - 1)];
+	s_Timers[i].Next = *pHead;
+	*pHead = i;
+	s_Timers[i].Flags |= SF_LINKED;
+}
+
+// Takes a timer out of its slot.
+static void Unlink(uint8_t i)
+{
+	uint8_t *pLink = &s_Slot[s_Timers[i].Due & (SCHED_NSLOTS - 1)];
+	while(*pLink != SCHED_NONE)
+	{
+		if(*pLink == i)
+		{
+			*pLink = s_Timers[i].Next;
+			break;
+		}
+		pLink = &s_Timers[*pLink].Next;
+	}
+	s_Timers[i].Flags &= ~SF_LINKED;
+}
+
+// Returns msecs in ticks, rounded up, and at least 1.
+static uint16_t Ticks(uint16_t ms)
+{
+	uint16_t t = ((uint32_t) ms * SCHED_TICKQ16 + 65535) >> 16;
+	return t ? t : 1;
+}
+
+// --------------------------------------------------------
+// Sched_GetStats()
+// Copies out the diagnostics.
+void Sched_GetStats(SchedStats *pStats)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		pStats->Overruns = s_iOverruns;
+		pStats->Misses = s_iMisses;
+		pStats->MaxLate = ((uint32_t) s_iMaxLate * SYS_T0CYCLES) / (F_CPU / 1000);
+		pStats->MaxTickCycles = s_iMaxTickCycles;
+	}
+}
+
+// Clears the diagnostics.
+void Sched_ClearStats()
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		s_iOverruns = 0;
+		s_iMisses = 0;
+		s_iMaxLate = 0;
+		s_iMaxTickCycles = 0;
+	}
+}
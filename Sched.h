@@ -0,0 +1,36 @@
+/*
+ * Sched.h
+ *
+ * Timers, one-shot or periodic, run from the system clock tick.
+ *
+ * Created: 10/18/2026
+ */
+
+#ifndef SCHED_H_
+#define SCHED_H_
+
+#include "MainDef.h"
+
+#define SCHED_NTIMERS  6        // Most timers at once.
+#define SCHED_NONE     0xFF     // No timer.
+
+// Flags for Sched_Add().
+#define SCHED_DEFER    0x00     // Run the callback from Sched_Poll(), in the main loop.
+#define SCHED_ISR      0x01     // Run the callback in the tick interrupt, with interrupts off.
+
+typedef struct
+{
+	uint16_t Overruns;          // Deferred firings dropped, as the last one had not yet run.
+	uint16_t Misses;            // Deferred callbacks run more than SCHED_SLACK ticks late.
+	uint16_t MaxLate;           // Most a deferred callback was late, in msecs.
+	uint16_t MaxTickCycles;     // Most CPU cycles taken by a tick, with its ISR callbacks.
+} SchedStats;
+
+uint8_t Sched_Add(void (*pCallback)(), uint16_t delay, uint16_t period, uint8_t flags);
+void Sched_Cancel(uint8_t id);
+void Sched_Tick();
+void Sched_Poll();
+void Sched_GetStats(SchedStats *pStats);
+void Sched_ClearStats();
+
+#endif /* SCHED_H_ */
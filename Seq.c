@@ -0,0 +1,196 @@
+/*
+ * Seq.c
+ *
+ * Sequencing of the motor relay and the PWM output.  Switching the relay
+ * while the ESC is driving the motor arcs the contacts, and closing it
+ * while the output is away from neutral can make the ESC start with a
+ * jump, or fail to arm.  So the order is always:
+ *
+ *     Start:  output to neutral -> settle -> close relay -> wait -> on
+ *     Stop:   output to neutral -> settle -> open relay  -> wait -> off
+ *
+ * Each step ends on a deadline from the system clock, checked by
+ * Seq_Poll(), so the caller can keep the screen live while it waits.
+ * The deadlines are compared by the sign of the difference, so they
+ * work across a wrap of the clock.  Seq_MotorOn() and Seq_MotorOff() are
+ * for callers that have nothing else to do; they poll, sleeping between
+ * interrupts.
+ *
+ * If the output does not reach neutral within SEQ_NEUTRALTIMEOUT (the
+ * ramp is that slow, or something else is still driving it), the
+ * sequence latches CTL_FAULT_SEQ, which stops anything driving the
+ * output.  A start is given up, with the relay left open; a stop goes
+ * on and opens the relay, since the motor must not be left powered.
+ *
+ * The time taken to reach neutral, and the total for each sequence, are
+ * kept so the settle and relay times can be trimmed, to the nearest
+ * msec.
+ *
+ * Created: 10/18/2026
+ */
+
+#include "MainDef.h"
+#include "SysClock.h"
+#include "PWM.h"
+#include "Control.h"
+#include "Seq.h"
+
+#define SEQ_PAST(now, t)  ((int32_t) ((now) - (t)) >= 0)   // True if time t has come.
+
+static volatile uint8_t s_iState = SEQ_OFF;
+static uint32_t s_iStart = 0;          // Time the sequence began.
+static uint32_t s_iDeadline = 0;       // Time the current step ends.
+static uint16_t s_iTimes[SEQ_NTIMES];  // Transition times, SEQ_T_xxx.
+
+static void SetDeadline(uint16_t ms);
+
+// --------------------------------------------------------
+// Seq_Start()
+// Starts closing the motor relay.  The caller must not drive
+// the output until Seq_Poll() returns SEQ_ON.
+void Seq_Start()
+{
+	if(s_iState == SEQ_ON || (s_iState >= SEQ_NEUTRAL && s_iState <= SEQ_CLOSE)) return;
+	PWM_SetWidth(CTL_NEUTRAL);
+	s_iStart = GetSystemTime();
+	s_iState = SEQ_NEUTRAL;
+}
+
+// --------------------------------------------------------
+// Seq_Stop()
+// Starts opening the motor relay.  Whatever is driving the
+// output must be stopped first.
+void Seq_Stop()
+{
+	if(s_iState == SEQ_OFF || s_iState >= SEQ_DISABLE) return;
+	PWM_SetWidth(CTL_NEUTRAL);
+	if(s_iState == SEQ_NEUTRAL || s_iState == SEQ_SETTLE)
+	{
+		// The relay was never closed.
+		s_iState = SEQ_OFF;
+		return;
+	}
+	s_iStart = GetSystemTime();
+	s_iState = SEQ_DISABLE;
+}
+
+// --------------------------------------------------------
+// Seq_Poll()
+// Moves the sequence along when its deadline has passed.
+// Call often.  Returns the state.
+uint8_t Seq_Poll()
+{
+	uint32_t now = GetSystemTime();
+	switch(s_iState)
+	{
+		case SEQ_NEUTRAL:
+			if(PWM_GetWidth() != CTL_NEUTRAL)
+			{
+				if(!SEQ_PAST(now, s_iStart + SEQ_NEUTRALTIMEOUT)) break;
+				Control_SetFault(CTL_FAULT_SEQ);
+				PWM_SetWidth(CTL_NEUTRAL);
+				s_iState = SEQ_OFF;
+				break;
+			}
+			s_iTimes[SEQ_T_NEUTRALUP] = now - s_iStart;
+			SetDeadline(eeprom_read_word(&eeSeqSettle));
+			s_iState = SEQ_SETTLE;
+			break;
+		case SEQ_SETTLE:
+			if(!SEQ_PAST(now, s_iDeadline)) break;
+			MotorRelayOn();
+			SetDeadline(eeprom_read_word(&eeSeqRelay));
+			s_iState = SEQ_CLOSE;
+			break;
+		case SEQ_CLOSE:
+			if(!SEQ_PAST(now, s_iDeadline)) break;
+			s_iTimes[SEQ_T_UP] = now - s_iStart;
+			s_iState = SEQ_ON;
+			break;
+		case SEQ_DISABLE:
+			if(PWM_GetWidth() != CTL_NEUTRAL)
+			{
+				if(!SEQ_PAST(now, s_iStart + SEQ_NEUTRALTIMEOUT)) break;
+				Control_SetFault(CTL_FAULT_SEQ);
+				PWM_SetWidth(CTL_NEUTRAL);
+			}
+			s_iTimes[SEQ_T_NEUTRALDN] = now - s_iStart;
+			SetDeadline(eeprom_read_word(&eeSeqSettle));
+			s_iState = SEQ_QUIET;
+			break;
+		case SEQ_QUIET:
+			if(!SEQ_PAST(now, s_iDeadline)) break;
+			MotorRelayOff();
+			SetDeadline(eeprom_read_word(&eeSeqRelay));
+			s_iState = SEQ_OPEN;
+			break;
+		case SEQ_OPEN:
+			if(!SEQ_PAST(now, s_iDeadline)) break;
+			s_iTimes[SEQ_T_DN] = now - s_iStart;
+			s_iState = SEQ_OFF;
+			break;
+	}
+	return s_iState;
+}
+
+// Sets the deadline for the current step, ms from now.
+static void SetDeadline(uint16_t ms)
+{
+	s_iDeadline = GetSystemTime() + ms;
+}
+
+// Returns the state, SEQ_xxx.
+uint8_t Seq_GetState()
+{
+	return s_iState;
+}
+
+// Returns True if the relay is closed and the output may be driven.
+bool8 Seq_IsOn()
+{
+	return s_iState == SEQ_ON;
+}
+
+// --------------------------------------------------------
+// Seq_MotorOn()
+// Runs the start sequence to the end.  If the output can't be
+// brought to neutral, it gives up with CTL_FAULT_SEQ latched, and
+// the relay open.
+void Seq_MotorOn()
+{
+	Seq_Start();
+	uint8_t st;
+	while((st = Seq_Poll()) != SEQ_ON && st != SEQ_OFF) sleep_mode();
+}
+
+// --------------------------------------------------------
+// Seq_MotorOff()
+// Runs the stop sequence to the end.  Bounded by the neutral
+// timeout and the settle and relay times.
+void Seq_MotorOff()
+{
+	Seq_Stop();
+	while(Seq_Poll() != SEQ_OFF) sleep_mode();
+}
+
+// --------------------------------------------------------
+// Seq_PowerOff()
+// Stops whatever is driving the output (by latching an abort
+// fault), opens the motor relay in order, and then turns the
+// power off.
+void Seq_PowerOff()
+{
+	if(s_iState != SEQ_OFF)
+	{
+		Control_SetFault(CTL_FAULT_ABORT);
+		Seq_MotorOff();
+	}
+	PwrRelayOff();
+}
+
+// Returns one of the transition times, SEQ_T_xxx, in msecs.
+uint16_t Seq_GetTime(uint8_t iTime)
+{
+	if(iTime >= SEQ_NTIMES) return 0;
+	return s_iTimes[iTime];
+}
@@ -0,0 +1,46 @@
+/*
+ * Seq.h
+ *
+ * Sequencing of the motor relay and the PWM output.
+ *
+ * Created: 10/18/2026
+ */
+
+#ifndef SEQ_H_
+#define SEQ_H_
+
+#include "MainDef.h"
+
+// Sequencer states.
+#define SEQ_OFF       0        // Relay open.
+#define SEQ_NEUTRAL   1        // Starting: waiting for the output to reach neutral.
+#define SEQ_SETTLE    2        // Starting: waiting for the ESC to settle at neutral.
+#define SEQ_CLOSE     3        // Starting: relay closed, waiting for the contacts.
+#define SEQ_ON        4        // Relay closed, output enabled.
+#define SEQ_DISABLE   5        // Stopping: waiting for the output to reach neutral.
+#define SEQ_QUIET     6        // Stopping: waiting for the current to die away.
+#define SEQ_OPEN      7        // Stopping: relay open, waiting for the contacts.
+
+// Transition times kept by the sequencer, in msecs.
+#define SEQ_T_NEUTRALUP  0     // Start: time to reach neutral.
+#define SEQ_T_UP         1     // Start: total, up to SEQ_ON.
+#define SEQ_T_NEUTRALDN  2     // Stop: time to reach neutral.
+#define SEQ_T_DN         3     // Stop: total, down to SEQ_OFF.
+#define SEQ_NTIMES       4
+
+#define SEQ_NEUTRALTIMEOUT 15000   // Longest wait for the output to reach neutral, in msecs.  The slowest ramp takes about 10s.
+
+EEu16(eeSeqSettle, 100);        // Time at neutral before the relay is switched, in msecs.
+EEu16(eeSeqRelay, 60);          // Time for the relay contacts to close or open, in msecs.
+
+void Seq_Start();
+void Seq_Stop();
+uint8_t Seq_Poll();
+uint8_t Seq_GetState();
+bool8 Seq_IsOn();
+void Seq_MotorOn();
+void Seq_MotorOff();
+void Seq_PowerOff();
+uint16_t Seq_GetTime(uint8_t iTime);
+
+#endif /* SEQ_H_ */
@@ -0,0 +1,253 @@
+/*
+ * Servo2.c
+ *
+ * One to four extra servo outputs, on BSpare1 to BSpare4, for driving a
+ * second ESC or servo next to the motor under test.  Timer1's second
+ * output (OC1A) is taken by the LCD, so these pulses are made in software
+ * with Timer2.
+ *
+ * Timer2 free runs at F_CPU/8 (0.8us per count), and overflows every 256
+ * counts (204.8us).  The overflow ISR counts the overflows to make the
+ * high byte of the time since the start of the frame.  A frame is
+ * SV_FRAMEWRAPS overflows (20.07ms, 49.8Hz).  At the start of a frame all
+ * the channel pins are set high.  Each pulse ends on an "edge": a time
+ * (high byte and low byte) and a mask of the pins to clear.  When the
+ * high byte of the next edge comes up, the low byte is put in OCR2A, and
+ * the compare ISR clears the pins.
+ *
+ * The edges are sorted, and edges at the same time merged, by
+ * Servo2_SetWidth(), in the main loop.  The schedule is double buffered:
+ * a new one is built in the spare buffer and swapped in by the ISR at the
+ * start of the next frame, so the ISR never sorts and a frame never mixes
+ * two schedules.
+ *
+ * If the next edge is less than SV_MARGIN counts away, there is no time
+ * to go in and out of the compare ISR, so the ISR waits on TCNT2 for it.
+ * That wait is at most SV_MARGIN counts (12.8us).
+ *
+ * Jitter, measured with HostSim/Servo2Sim.c, which runs this file on a
+ * model of Timer2 and the interrupt entry, over every width:  With no
+ * other interrupts, a pulse is from 2.1us short to 1.3us long.  Up to
+ * 0.8us of that is the count.  An edge made by the compare ISR is late
+ * by about the same entry time as the start of the frame, so that part
+ * cancels out.  But an edge that is waited for in ArmEdge() comes right
+ * on the count, so that pulse is short by the entry time.  Any other ISR
+ * that is running holds off both edges.  In the model, a 100 cycle ISR
+ * at 20KHz (the Timer1 overflow at the fast rates) gave -11.5us to
+ * +10.9us.  A 500 cycle ISR at the ADC frame rate gave up to +49.6us.
+ * So an edge can be late by about the length of the longest other ISR.
+ * That is fine for driving a second ESC or a servo.  It is not fine for
+ * the motor under test, which stays on the hardware output.  No edge was
+ * missed in any of the runs.
+ *
+ * BSpare3 and BSpare4 are also the H-bridge direction pins, so only two
+ * channels can run in the H-bridge mode.
+ *
+ * Created: 10/18/2026
+ */
+
+#include "MainDef.h"
+#include "PWM.h"
+#include "Servo2.h"
+
+#define SV_FRAMEWRAPS  98       // Timer2 overflows per frame.
+#define SV_MARGIN      16       // Edges closer than this, in counts, are waited for in the ISR.
+#define SV_MINWIDTH    500      // Width limits, in usecs.
+#define SV_MAXWIDTH    2500
+
+#define SV_PIN(i)      (BSpare1 + (i))   // Pin of channel i.
+
+typedef struct
+{
+	uint8_t n;                  // Number of edges.
+	uint8_t Hi[SV_NCHAN];       // Edge times: overflows since the start of the frame,
+	uint8_t Lo[SV_NCHAN];       // and Timer2 count.
+	uint8_t Mask[SV_NCHAN];     // Pins to clear on each edge.
+} SvSchedule;
+
+static SvSchedule s_Sched[2];
+static volatile uint8_t s_iActive = 0;      // Schedule used by the ISR.
+static volatile bool8 s_bNewSched = False;  // True if the spare schedule is ready.
+static const SvSchedule *s_pSched = &s_Sched[0];   // Schedule for this frame.
+static uint8_t s_iHi = 0;                   // Overflows since the start of the frame.
+static uint8_t s_iEdge = 0;                 // Next edge in the schedule.
+static uint8_t s_iPinMask = 0;              // Pins of the running channels.
+static uint8_t s_nChannels = 0;
+static uint16_t s_iWidth[SV_NCHAN];         // Widths, in usecs.
+
+static void BuildSchedule();
+static void ArmEdge();
+
+// Init the pins.  They stay as inputs until Servo2_On().
+void Servo2_Init()
+{
+	s_nChannels = 0;
+	s_iPinMask = 0;
+}
+
+// Starts nChannels channels, all at the given width in usecs.
+void Servo2_On(uint8_t nChannels, uint16_t width)
+{
+	Servo2_Off();
+	if(nChannels > SV_NCHAN) nChannels = SV_NCHAN;
+	if(PWM_GetProtocol() == PWM_HBRIDGE && nChannels > 2) nChannels = 2;
+	if(nChannels == 0) return;
+
+	s_nChannels = nChannels;
+	s_iPinMask = 0;
+	for(uint8_t i = 0; i < nChannels; i++)
+	{
+		s_iWidth[i] = width;
+		s_iPinMask |= _BV(SV_PIN(i));
+	}
+	PORTB &= ~s_iPinMask;
+	DDRB |= s_iPinMask;
+
+	BuildSchedule();
+	s_iActive ^= 1;
+	s_bNewSched = False;
+	s_pSched = &s_Sched[s_iActive];
+	s_iHi = SV_FRAMEWRAPS - 1;       // Start a frame on the first overflow.
+	s_iEdge = SV_NCHAN;
+
+	TCCR2A = 0;                      // Normal mode, no outputs.
+	TCNT2 = 0;
+	TIFR2 = _BV(TOV2) | _BV(OCF2A);
+	TIMSK2 = _BV(TOIE2);
+	TCCR2B = (0<<CS22)|(1<<CS21)|(0<<CS20);   // F_CPU/8.
+}
+
+// Sets the width of a channel, in usecs.  Takes effect at the
+// start of the next frame.
+void Servo2_SetWidth(uint8_t iChan, uint16_t width)
+{
+	if(iChan >= s_nChannels) return;
+	if(width < SV_MINWIDTH) width = SV_MINWIDTH;
+	if(width > SV_MAXWIDTH) width = SV_MAXWIDTH;
+	s_iWidth[iChan] = width;
+	BuildSchedule();
+}
+
+// Returns the width of a channel, in usecs.
+uint16_t Servo2_GetWidth(uint8_t iChan)
+{
+	if(iChan >= s_nChannels) return 0;
+	return s_iWidth[iChan];
+}
+
+// Returns the number of channels running.
+uint8_t Servo2_GetChannels()
+{
+	return s_nChannels;
+}
+
+// Stops Timer2, and leaves the pins floating.  In the H-bridge mode,
+// the direction pins are left alone: they belong to PWM.c.
+void Servo2_Off()
+{
+	TCCR2B = 0;
+	TIMSK2 = 0;
+	uint8_t mask = s_iPinMask;
+	if(PWM_GetProtocol() == PWM_HBRIDGE) mask &= ~(_BV(HbDirAPin) | _BV(HbDirBPin));
+	DDRB &= ~mask;
+	PORTB &= ~mask;
+	s_nChannels = 0;
+	s_iPinMask = 0;
+}
+
+// Sorts the channels by width into the spare schedule, and marks it
+// ready for the next frame.
+static void BuildSchedule()
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		// The ISR must not swap in the spare while it is being built.
+		s_bNewSched = False;
+	}
+	SvSchedule *p = &s_Sched[s_iActive ^ 1];
+	uint8_t order[SV_NCHAN];
+	for(uint8_t i = 0; i < s_nChannels; i++)
+	{
+		// Insertion sort: at most four channels.
+		uint8_t j = i;
+		while(j > 0 && s_iWidth[order[j-1]] > s_iWidth[i])
+		{
+			order[j] = order[j-1];
+			j--;
+		}
+		order[j] = i;
+	}
+	p->n = 0;
+	for(uint8_t i = 0; i < s_nChannels; i++)
+	{
+		uint8_t c = order[i];
+		uint16_t count = (s_iWidth[c] * 5) / 4;     // 0.8us per count.
+		uint8_t hi = count >> 8;
+		uint8_t lo = count & 0xFF;
+		if(p->n > 0 && p->Hi[p->n-1] == hi && p->Lo[p->n-1] == lo)
+		{
+			p->Mask[p->n-1] |= _BV(SV_PIN(c));
+			continue;
+		}
+		p->Hi[p->n] = hi;
+		p->Lo[p->n] = lo;
+		p->Mask[p->n] = _BV(SV_PIN(c));
+		p->n++;
+	}
+	s_bNewSched = True;
+}
+
+// Timer2 overflow, every 256 counts.  Starts the frames, and arms the
+// compare for edges that fall in this overflow.
+ISR(TIMER2_OVF_vect)
+{
+	if(++s_iHi >= SV_FRAMEWRAPS)
+	{
+		s_iHi = 0;
+		if(s_bNewSched)
+		{
+			s_iActive ^= 1;
+			s_bNewSched = False;
+		}
+		s_pSched = &s_Sched[s_iActive];
+		s_iEdge = 0;
+		PORTB |= s_iPinMask;
+	}
+	if(s_iEdge < s_pSched->n && s_pSched->Hi[s_iEdge] == s_iHi) ArmEdge();
+}
+
+// Timer2 compare: the next edge is due.
+ISR(TIMER2_COMPA_vect)
+{
+	BitOff(TIMSK2, OCIE2A);
+	PORTB &= ~s_pSched->Mask[s_iEdge];
+	s_iEdge++;
+	if(s_iEdge < s_pSched->n && s_pSched->Hi[s_iEdge] == s_iHi) ArmEdge();
+}
+
+// Sets up the compare for the next edge, which is in this overflow.
+// Edges that are too close are waited for here.
+static void ArmEdge()
+{
+	while(s_iEdge < s_pSched->n && s_pSched->Hi[s_iEdge] == s_iHi)
+	{
+		uint8_t lo = s_pSched->Lo[s_iEdge];
+		uint8_t t = TCNT2;
+		if(!BitTest(TIFR2, TOV2) && lo > t)
+		{
+			// Not due yet.  If there is time, let the compare do it,
+			// otherwise wait for it here.  (With interrupts off, this
+			// loop sees every count, so it can't miss lo.)
+			if(lo - t > SV_MARGIN)
+			{
+				OCR2A = lo;
+				TIFR2 = _BV(OCF2A);
+				BitOn(TIMSK2, OCIE2A);
+				return;
+			}
+			while(TCNT2 < lo) ;
+		}
+		PORTB &= ~s_pSched->Mask[s_iEdge];
+		s_iEdge++;
+	}
+}
@@ -0,0 +1,27 @@
+/*
+ * Servo2.h
+ *
+ * Extra servo outputs on the spare PORTB pins, timed with Timer2.
+ *
+ * Created: 10/18/2026
+ */
+
+#ifndef SERVO2_H_
+#define SERVO2_H_
+
+#include "MainDef.h"
+
+#define SV_NCHAN      4         // Most channels: BSpare1 to BSpare4.
+
+// Extra servo settings, used at power on.
+EEu8(eeServo2Chans, 0);         // Number of channels to run, 0 to SV_NCHAN.  0 = off.
+EEu16(eeServo2Width, 1500);     // Starting width for every channel, in usecs.
+
+void Servo2_Init();
+void Servo2_On(uint8_t nChannels, uint16_t width);
+void Servo2_SetWidth(uint8_t iChan, uint16_t width);
+uint16_t Servo2_GetWidth(uint8_t iChan);
+uint8_t Servo2_GetChannels();
+void Servo2_Off();
+
+#endif /* SERVO2_H_ */
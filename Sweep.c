@@ -0,0 +1,199 @@
+/*
+ * Sweep.c
+ *
+ * Motor characterisation sweep.  The width is stepped from eeSweepLo to
+ * eeSweepHi in SW_NSTEPS steps.  At each step, the sweep waits for the
+ * ramp stage to reach the new width, waits eeSweepSettle more, and then
+ * averages eeSweepAvg samples of current and battery voltage.  The
+ * averages are kept in a small table in RAM, for plotting.  The step's
+ * offset goes through Control_Output() every frame, so the stall
+ * throttle, the thermal derate and the battery correction apply: a
+ * point is taken at the width actually sent, which is the step's own
+ * unless one of them is acting.  As that width can move a little from
+ * frame to frame, the ramp is done when the PWM has been at the width
+ * it had taken in a period since the step started (PWM_GetSettledCycles()),
+ * not when it matches the latest one.
+ *
+ * The sweep runs from the ADC frame callback, so it goes as fast as the
+ * settle time allows, no matter what the UI is doing.  The current and
+ * voltage for a sample always come from the same ADC frame.  It can't
+ * run at the same time as the current loop, which uses the same callback.
+ *
+ * Created: 10/18/2026
+ */
+
+#include "MainDef.h"
+#include "ADC.h"
+#include "PWM.h"
+#include "Control.h"
+#include "Sweep.h"
+
+// Phases of one step.
+#define PH_RAMP     0          // Waiting for the output to reach the width.
+#define PH_SETTLE   1          // Waiting for the motor to settle.
+#define PH_AVG      2          // Taking samples.
+
+static SweepPoint s_Points[SW_NSTEPS];   // The results.
+static volatile uint8_t s_iState = SW_IDLE;
+static volatile uint8_t s_iStep = 0;     // Step being measured.
+static uint8_t  s_iPhase = PH_RAMP;
+static int16_t  s_iLo = 0;               // Settings, loaded at the start.
+static int16_t  s_iHi = 0;
+static uint16_t s_nSettle = 0;           // Settle time, in ADC frames.
+static uint8_t  s_nAvg = 1;
+static uint16_t s_iCount = 0;            // Frames left in this phase.
+static int16_t  s_iOffset = 0;           // Offset for this step, in usecs.
+static uint16_t s_iTarget = 0;           // Width for this step, in 1/16 usecs.
+static uint32_t s_tStep = 0;             // Time the step's width was set, in CPU cycles.
+static int32_t  s_iSumAmps = 0;
+static int32_t  s_iSumVolts = 0;
+
+static void Sweep_Frame();
+static void LoadStep();
+static void StepOutput();
+static void Finish(uint8_t state);
+
+// --------------------------------------------------------
+// Sweep_Start()
+// Starts a sweep with the settings in EEPROM.  The motor relay
+// must already be closed.  Returns False if there is a fault.
+bool8 Sweep_Start()
+{
+	if(Control_GetFault()) return False;
+	Sweep_Stop();
+	s_iLo = eeprom_read_word((uint16_t *) &eeSweepLo);
+	s_iHi = eeprom_read_word((uint16_t *) &eeSweepHi);
+	s_nSettle = ((uint32_t) eeprom_read_word(&eeSweepSettle) * ADC_FRAMERATE) / 1000;
+	s_nAvg = eeprom_read_byte(&eeSweepAvg);
+	if(s_nAvg == 0) s_nAvg = 1;
+	for(uint8_t i = 0; i < SW_NSTEPS; i++)
+	{
+		s_Points[i].Amps = 0;
+		s_Points[i].Volts = 0;
+	}
+	s_iStep = 0;
+	LoadStep();
+	s_iState = SW_RUNNING;
+	ADC_SetFrameCallback(Sweep_Frame);
+	return True;
+}
+
+// --------------------------------------------------------
+// Sweep_Stop()
+// Stops the sweep, and returns the output to neutral.
+void Sweep_Stop()
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		if(s_iState == SW_RUNNING) Finish(SW_ABORTED);
+	}
+}
+
+// Called from the ADC interrupt at the end of each frame.
+static void Sweep_Frame()
+{
+	if(s_iState != SW_RUNNING) return;
+	if(Control_GetFault())
+	{
+		Finish(SW_ABORTED);
+		return;
+	}
+	StepOutput();
+	switch(s_iPhase)
+	{
+		case PH_RAMP:
+			if((int32_t) (PWM_GetSettledCycles() - s_tStep) <= 0) return;
+			s_iPhase = PH_SETTLE;
+			s_iCount = s_nSettle;
+			// Fall through.
+		case PH_SETTLE:
+			if(s_iCount > 0)
+			{
+				s_iCount--;
+				return;
+			}
+			s_iPhase = PH_AVG;
+			s_iCount = s_nAvg;
+			s_iSumAmps = 0;
+			s_iSumVolts = 0;
+			// Fall through.
+		case PH_AVG:
+			s_iSumAmps += ADC_GetCurrent();
+			s_iSumVolts += ADC_GetBatteryVoltage();
+			if(--s_iCount > 0) return;
+			s_Points[s_iStep].Amps = s_iSumAmps / s_nAvg;
+			s_Points[s_iStep].Volts = s_iSumVolts / s_nAvg;
+			if(++s_iStep >= SW_NSTEPS)
+			{
+				Finish(SW_DONE);
+				return;
+			}
+			LoadStep();
+			break;
+	}
+}
+
+// Sets the width for the current step.
+static void LoadStep()
+{
+	s_iOffset = Sweep_GetOffset(s_iStep);
+	s_iTarget = 0;
+	s_iPhase = PH_RAMP;
+	StepOutput();
+	s_tStep = PWM_GetCycles();
+}
+
+// Sets the width from the step's offset, through Control_Output().
+// Only sent to the PWM when it changes.
+static void StepOutput()
+{
+	uint16_t target = (uint16_t) (CTL_NEUTRAL + Control_Output(s_iOffset)) << 4;
+	if(target == s_iTarget) return;
+	s_iTarget = target;
+	PWM_SetWidth(target >> 4);
+}
+
+// Ends the sweep, and returns the output to neutral.
+static void Finish(uint8_t state)
+{
+	ADC_SetFrameCallback(NULL);
+	PWM_SetWidth(CTL_NEUTRAL);
+	s_iState = state;
+}
+
+// --------------------------------------------------------
+// Sweep_GetState()
+// Returns SW_IDLE, SW_RUNNING, SW_DONE or SW_ABORTED.
+uint8_t Sweep_GetState()
+{
+	return s_iState;
+}
+
+// Returns the step being measured.  Once done, returns SW_NSTEPS.
+uint8_t Sweep_GetStep()
+{
+	return s_iStep;
+}
+
+// Returns the width offset from neutral of a step, in usecs.
+int16_t Sweep_GetOffset(uint8_t iStep)
+{
+	return s_iLo + (int16_t) (((int32_t) (s_iHi - s_iLo) * iStep) / (SW_NSTEPS - 1));
+}
+
+// Copies out the result of a step.
+void Sweep_GetPoint(uint8_t iStep, SweepPoint *pPoint)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		*pPoint = s_Points[iStep];
+	}
+}
+
+// Returns the power drawn at a step, in 10th of Watts.
+int16_t Sweep_GetWatts(uint8_t iStep)
+{
+	SweepPoint p;
+	Sweep_GetPoint(iStep, &p);
+	return (int16_t) (((int32_t) p.Amps * p.Volts) / 10000);
+}
@@ -0,0 +1,42 @@
+/*
+ * Sweep.h
+ *
+ * Motor characterisation sweep.
+ *
+ * Created: 10/18/2026
+ */
+
+#ifndef SWEEP_H_
+#define SWEEP_H_
+
+#include "MainDef.h"
+
+#define SW_NSTEPS   24         // Points in a sweep.
+
+// Sweep states.
+#define SW_IDLE     0
+#define SW_RUNNING  1
+#define SW_DONE     2
+#define SW_ABORTED  3
+
+// Sweep settings.
+EEi16(eeSweepLo, 0);            // First width offset from neutral, in usecs.
+EEi16(eeSweepHi, 400);          // Last width offset from neutral, in usecs.
+EEu16(eeSweepSettle, 300);      // Time to settle at each step, in msecs.
+EEu8(eeSweepAvg, 64);           // Samples (ADC frames) averaged at each step.
+
+typedef struct
+{
+	int16_t Amps;              // Average current, in 100th of Amps.
+	int16_t Volts;             // Average battery voltage, in mV.
+} SweepPoint;
+
+bool8 Sweep_Start();
+void Sweep_Stop();
+uint8_t Sweep_GetState();
+uint8_t Sweep_GetStep();
+int16_t Sweep_GetOffset(uint8_t iStep);
+void Sweep_GetPoint(uint8_t iStep, SweepPoint *pPoint);
+int16_t Sweep_GetWatts(uint8_t iStep);
+
+#endif /* SWEEP_H_ */
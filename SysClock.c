@@ -1,56 +1,81 @@
 /*
  * SysClock.c
  *
- * Modified Sys clock, where interrupt is triggered approximately every
- * 0.020 seconds.  Upon trigger, interrupts are turned off for up to 2ms, to 
- * accomplish generating the PWM signal.   
+ * Provides the system clocks, from hardware Timer0.  The timer counts at
+ * F_CPU/1024, and interrupts every SYS_T0TOP+1 counts, which at 10MHz is
+ * 196 * 1024 cycles, or 20.0704ms: close to 20ms, but not exactly.  So,
+ * rather than add a fixed 20ms per interrupt (which ran 0.35% slow), the
+ * interrupt adds the whole part of the true period, and keeps the rest
+ * as a fraction, in 1/F_CPU units, carrying into the clock as it fills.
+ * There is no long term drift: the clocks are as good as the crystal.
  *
- * Time is a
+ * Two clocks are kept:
  *
- 
- * Provides a system clock that is accurate to plus or minus 1ms. 
- * Uses hardware Timer0 and interrupts to accomplish this.  Interrupt is
- * triggered every 0.0128 seconds, or about 78 Hz.  I.e., this clock uses
- * very little overhead.
+ *     GetMicros()     usecs, 32 bits.  Rolls over every 71.6 minutes, so
+ *                     use it for time differences, which are right across
+ *                     the roll over.
+ *     GetMillis64()   msecs, 64 bits.  Never rolls over.
  *
- * Also provides a hook into the actual timer interrupt routine.  A call back
- * can be configured to trigger at a given time.  Either way, to avoid a
- * linker error, the routine SlowInterrupt() must be defined in external code.
+ * GetSystemTime() is the low 32 bits of the msecs clock, and rolls over
+ * about once every 50 days.
  *
- * Note that before calling SlowInterrupt, the global interrupts are enabled.
- * Therefore, SlowInterrupt should be fairly quick to avoid deeply nested interrupt
- * processing.
+ * Between interrupts, the clocks are brought up to date from TCNT0, so
+ * they step every count (102.4us), not every interrupt.  If the compare
+ * has happened but its interrupt not yet run (say, when called from
+ * another ISR), the period is added by hand, so the clocks never go back.
+ * Reading a clock takes a few us, with interrupts off for a few cycles,
+ * so they are fine for stamping events from ISRs.
+ *
+ * Each interrupt also ticks the timers in Sched.c, which replace the
+ * single SlowInterrupt() call back this used to have.
  *
  * NOTE: this code was taken from the KK board stuff that operated with a 20MHz
- * crystal.  This version works with any F_CPU greater than 80KHz.  However, 
- * accuracy is only maintained when F_CPU is evenly divisible by 80K.
+ * crystal.  This version works with any F_CPU from 80KHz to 13MHz, for which
+ * the timer's TOP fits in 8 bits.
  *
  * Created: 4/18/2013 11:07:59 AM
  * Author: Dal
  */ 
 
 #include "MainDef.h"
+#include "Sched.h"
 #include "SysClock.h"
 
-volatile uint32_t gTime = 0;    // System Time Counter.  LSB = 10ms. 
+// Each interrupt adds the whole part of the period, and the remainder, in
+// 1/F_CPU units, to the fraction.
+#define SYS_USWHOLE   ((uint32_t) ((SYS_T0CYCLES * 1000000ULL) / F_CPU))
+#define SYS_USREM     ((uint32_t) ((SYS_T0CYCLES * 1000000ULL) % F_CPU))
+#define SYS_MSWHOLE   ((uint32_t) ((SYS_T0CYCLES * 1000ULL) / F_CPU))
+#define SYS_MSREM     ((uint32_t) ((SYS_T0CYCLES * 1000ULL) % F_CPU))
+
+// One count of TCNT0: in usecs, with 8 fraction bits, and in msecs, with
+// 16 fraction bits.  And the msecs fraction, >> 8, to 16 fraction bits,
+// with 8 more.
+#define SYS_CNTUSQ8   ((uint32_t) (1024.0 * 1000000 * 256 / F_CPU + 0.5))
+#define SYS_CNTMSQ16  ((uint32_t) (1024.0 * 1000 * 65536 / F_CPU + 0.5))
+#define SYS_FRACQ16   ((uint32_t) (65536.0 * 65536 / F_CPU + 0.5))
 
-volatile bool8  gbEnableSlowInterrupt = False;  // Indicates that the slow interrupt is enabled.
-volatile uint32_t gNextSlowInterrupt        = 0;  // Time that the slow interrupt will trigger.
+static volatile uint32_t gMicros = 0;      // usecs, at the last interrupt.
+static volatile uint32_t gUsFrac = 0;      // And the fraction, in 1/F_CPU usecs.
+static volatile uint64_t gMillis = 0;      // msecs, at the last interrupt.
+static volatile uint32_t gMsFrac = 0;      // And the fraction, in 1/F_CPU msecs.
+
+static uint8_t Snapshot(uint32_t *pMicros, uint64_t *pMillis, uint32_t *pMsFrac);
 
 // --------------------------------------------------------
 // SetupSystemTimeCounter()
-// Sets up Timer0 to trigger once every 0.020 seconds.
+// Sets up Timer0 to trigger about once every 0.020 seconds.
 void SetupSystemTimeCounter()
 {
     // On overflow, the Timer will trigger an interrupt.
     // Input to this 8-bit timer will be system clock (F_CPU) / 1024.  To
     // calculate the overflow count, OCR0A, to get close to 0.020 seconds,
-	// we have:  0.020secs = OCR0A * (1024 / F_CPU).
-	// Or OCR0A = (F_CPU / 1024) * 0.020
-	//          = (F_CPU / 51200)
-	// Timer counts at a rate of F_CPU/1024 = 9.765625 KHz.  Period is 0.1ms.
+	// we have:  0.020secs = (OCR0A + 1) * (1024 / F_CPU).
+	// Or OCR0A = (F_CPU / 1024) * 0.020 - 1
+	// which rounds down to (F_CPU / 51200), a little long.
+	// Timer counts at a rate of F_CPU/1024 = 9.765625 KHz.  Period is 0.1024ms.
 
-    OCR0A = (uint8_t) (F_CPU / 51200UL);   //=195 for 10MHz, which is under 8 bits.
+    OCR0A = SYS_T0TOP;     //=195 for 10MHz, which is under 8 bits.
 	OCR0B = 0;             // Not used, but set for readability.
 	TCCR0A = 0b00000010;   // Selects Clear Timer on Compare mode
 	TCCR0B = 0b00000101;   // This divides the System Clock by 1024, as input to the timer.
@@ -61,84 +86,80 @@ void SetupSystemTimeCounter()
 // --------------------------------------------------------
 // ISR()
 // Interrupt on Timer0 compare.
-// Come here to track system time.  Resolution is 0.020 seconds -- see setup.
+// Come here to track system time.  Adds one period to the clocks,
+// with the fractions carried, and ticks the timers.
 ISR(TIMER0_COMPA_vect)
 {
-	gTime++;			// This adds 10ms to the time.
-	gTime++;            // And another 10ms to the time. 
-	if(gbEnableSlowInterrupt)
+	gMicros += SYS_USWHOLE;
+	gUsFrac += SYS_USREM;
+	if(gUsFrac >= F_CPU)
 	{
-		if(gTime >= gNextSlowInterrupt)
-		{
-			gbEnableSlowInterrupt = False;
-			sei();                           // Interrupts are enabled during processing of SlowInterrupt()!
-			SlowInterrupt();
-		}
+		gUsFrac -= F_CPU;
+		gMicros++;
+	}
+	gMillis += SYS_MSWHOLE;
+	gMsFrac += SYS_MSREM;
+	if(gMsFrac >= F_CPU)
+	{
+		gMsFrac -= F_CPU;
+		gMillis++;
 	}
+	Sched_Tick();
 }
 
-// --------------------------------------------------------
-// GetSystemTime()
-// Returns the system clock, accurate to 1ms.  LSB = 1ms.
-// Starts at zero on powerup, and then rolls over about once
-// every 50 days.
-uint32_t GetSystemTime()
+// Takes the clocks at the last interrupt and TCNT0, all at once.  If the
+// compare has happened, and its interrupt is waiting, the period is
+// added, and TCNT0 is read again, after the clear.  Returns TCNT0.
+static uint8_t Snapshot(uint32_t *pMicros, uint64_t *pMillis, uint32_t *pMsFrac)
 {
-	// Take a snapshot of all the relevant registers.
-    
-    uint32_t v;
-    uint16_t t;
+	uint8_t t;
 	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
-    {
-	    v = gTime;
-	    t = TCNT0;
-    }
-	uint32_t vout = v*10; // + (975*(uint32_t)t)/100L;
-	return vout;
-}	
-
+	{
+		if(pMicros) *pMicros = gMicros;
+		if(pMillis)
+		{
+			*pMillis = gMillis;
+			*pMsFrac = gMsFrac;
+		}
+		t = TCNT0;
+		if(TIFR0 & _BV(OCF0A))
+		{
+			t = TCNT0;
+			if(pMicros) *pMicros += SYS_USWHOLE;
+			if(pMillis) *pMillis += SYS_MSWHOLE;
+		}
+	}
+	return t;
+}
 
 // --------------------------------------------------------
-// SetSlowInterrupt()
-// Sets the slow interrupt to trigger when the given time
-// occurs.  After trigger, the slow interrupt is disabled.
-// Note, NextTime is specified in milliseconds, but that the
-// actual trigger will be accurate only to tens of milliseconds.
-void SetSlowInterrupt(uint32_t NextTime)
+// GetMicros()
+// Returns the time since power on, in usecs, to the nearest
+// count of Timer0 (102.4us).  Rolls over every 71.6 minutes.
+uint32_t GetMicros()
 {
-	gbEnableSlowInterrupt = True;
-	gNextSlowInterrupt = NextTime / 10;
+	uint32_t v;
+	uint8_t t = Snapshot(&v, NULL, NULL);
+	return v + ((t * SYS_CNTUSQ8) >> 8);
 }
 
 // --------------------------------------------------------
-// ClearSlowInterrupt()
-// Turns off any pending slow interrupt.  Note, that when the 
-// executing thread enters this routine, a slow interrupt might
-// be on the verge of being triggered, and if so, the interrupt
-// routine might be allowed to run before this routine returns.
-// HOWEVER, after this routine has returned, the caller can be
-// assured that no further slow interrupt will be triggered
-// until the slow interrupt is re-enabled.
-void ClearSlowInterrupt()
+// GetMillis64()
+// Returns the time since power on, in msecs.  Never rolls over.
+uint64_t GetMillis64()
 {
-	gbEnableSlowInterrupt = False;
-	gNextSlowInterrupt = 0;
+	uint64_t v;
+	uint32_t frac;
+	uint8_t t = Snapshot(NULL, &v, &frac);
+	return v + (((((frac >> 8) * SYS_FRACQ16) >> 8) + t * SYS_CNTMSQ16) >> 16);
 }
 
 // --------------------------------------------------------
-// TimeTillSlowInterrupt()
-// Gets the time remaining, in milliseconds, until the next
-// slow interrupt will be fired.  If no interrupt is set to
-// go off then SLOW_INTR_OFF is returned.  If the interrupt
-// is in the process of being triggered, then SLOW_INTR_PROCESSING
-// is returned.  Otherwise a number greater than 5 is returned.
-uint32_t TimeTillSlowInterrupt()
+// GetSystemTime()
+// Returns the system clock, accurate to 1ms.  LSB = 1ms.
+// Starts at zero on powerup, and then rolls over about once
+// every 50 days.
+uint32_t GetSystemTime()
 {
-	if(!gbEnableSlowInterrupt) return SLOW_INTR_OFF;
-	uint32_t tTime = GetSystemTime();
-	uint32_t tTrigger = gNextSlowInterrupt * 10;
-	if(tTime > tTrigger) return SLOW_INTR_PROCESSING;
-	uint32_t d = tTrigger - tTime;
-	if(d <= 5) return SLOW_INTR_PROCESSING;
-	return d;
-}	
+	return (uint32_t) GetMillis64();
+}
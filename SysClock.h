@@ -2,6 +2,7 @@
  * SysClock.h
  *
  * Provides a system clock that counts in 1 ms ticks.  Roll over is 50 days.
+ * Also a usec clock (roll over 71.6 minutes), and a 64 bit msec clock.
  *
  * Created: 4/18/2013 11:08:17 AM
  * Author: Dal
@@ -11,14 +12,12 @@
 #ifndef SYSCLOCK_H_
 #define SYSCLOCK_H_
 
-#define SLOW_INTR_OFF  0  
-#define SLOW_INTR_PROCESSING 1
+#define SYS_T0TOP     ((uint8_t) (F_CPU / 51200UL))            // Timer0 OCR0A: 195 for 10MHz.
+#define SYS_T0CYCLES  (((uint32_t) SYS_T0TOP + 1) * 1024)      // CPU cycles per tick (interrupt).
 
 void SetupSystemTimeCounter();
 uint32_t GetSystemTime();
-void SetSlowInterrupt(uint32_t NextTime);
-void ClearSlowInterrupt();
-uint32_t TimeTillSlowInterrupt();
-void SlowInterrupt();						// This must be implemented by user.
+uint32_t GetMicros();
+uint64_t GetMillis64();
 
 #endif /* SYSCLOCK_H_ */
\ No newline at end of file
@@ -0,0 +1,261 @@
+/*
+ * Tach.c
+ *
+ * Speed feedback from a single pulse tach, or a quadrature encoder, on
+ * the spare PD2 and PD3 pins.  These are the capture inputs too, so the
+ * tach is stopped while the capture screen is up.  The pins use the pin
+ * change interrupt (PCINT3), not INT0/INT1, which belong to Capture.c.
+ * The pull-ups are on, for open collector hall sensors.
+ *
+ * The ISR only counts edges (for a quadrature encoder, +1 or -1 from a
+ * table, by the old and new A/B state), and, if asked to, stamps the
+ * edge with PWM_GetCycles().  It has no loops and no division, so its
+ * cost is fixed: of the order of 100 cycles with the stamp, and 60
+ * without.  At 20000 edges per second, in TACH_COUNT, where nearly all
+ * edges skip the stamp, that is about 12% of the CPU.
+ *
+ * The RPM is worked out once per control tick (the window, 20ms), in
+ * Tach_Tick(), from the edges between the last stamped edge of this
+ * window and that of the one before, and the time between them.  As
+ * both ends are edges, there is no +/-1 edge error, however few edges
+ * there are.  Two modes, picked by the edge rate, with hysteresis:
+ *
+ *     TACH_PERIOD:  Every edge is stamped.  At low speed, there are a
+ *                   few edges per window, and the RPM is from the time
+ *                   between them.  If no edge comes, the RPM is held
+ *                   down to what one edge in the time since the last
+ *                   would give, and is zero after TACH_TIMEOUT.
+ *     TACH_COUNT:   Only the first edge after each window starts is
+ *                   stamped, so at high speed the ISR does little more
+ *                   than count, and the RPM is from the count.
+ *
+ * With TACH_RIPPLE, the pins are not used, and the RPM comes from the
+ * current ripple instead, from Ripple.c.
+ *
+ * The RPM is published with the ADC readings, in ADC_GetSnapshot().
+ *
+ * Created: 10/18/2026
+ */
+
+#include "MainDef.h"
+#include "PWM.h"
+#include "Ripple.h"
+#include "Tach.h"
+
+#define TACH_FRAC      2                // Fraction bits in the cycles per edge.
+#define TACH_TOCOUNT   16               // Edges per window to go to TACH_COUNT,
+#define TACH_TOPERIOD  8                // and to go back to TACH_PERIOD.
+#define TACH_TIMEOUT   F_CPU            // No edge for this long (in cycles) means stopped.
+#define TACH_MAXRPM    32767
+
+// The pins, as bits 0 (A) and 1 (B) of the state.  DSpare2 and DSpare3
+// are next to each other.
+#define TACH_AB()      ((PIND >> DSpare2) & 3)
+
+// Steps of a quadrature encoder, by (old state << 2) | new state.  The
+// sequence forward is 00, 01, 11, 10.  Both pins changing at once is
+// not a step.
+static const int8_t s_QuadStep[16] PROGMEM =
+{
+	 0,  1, -1,  0,
+	-1,  0,  0,  1,
+	 1,  0,  0, -1,
+	 0, -1,  1,  0
+};
+
+static const char s_sOff[] PROGMEM = "Off";
+static const char s_sPulse[] PROGMEM = "Pulse";
+static const char s_sQuad[] PROGMEM = "Quad";
+static const char s_sRipple[] PROGMEM = "Ripple";
+static PGM_P const s_TypeNames[] PROGMEM = {s_sOff, s_sPulse, s_sQuad, s_sRipple};
+
+// Shared with the ISR.
+static volatile uint8_t s_iType = TACH_OFF;
+static volatile int16_t s_iCount = 0;          // Edges, signed for an encoder.
+static volatile uint8_t s_iAB = 0;             // Last encoder state.
+static volatile bool8 s_bStamp = False;        // True to stamp the next edge.
+static volatile bool8 s_bStampAll = False;     // True to stamp every edge (TACH_PERIOD).
+static volatile uint32_t s_iEdgeTime = 0;      // Time of the last stamped edge, in CPU cycles.
+static volatile int16_t s_iEdgeCount = 0;      // Count at that edge.
+
+// Used by Tach_Tick().
+static uint32_t s_iK = 0;                      // 60 * F_CPU / (edges per rev), with TACH_FRAC fraction bits.
+static bool8 s_bPrev = False;                  // True once an edge has been stamped.
+static uint32_t s_iPrevTime = 0;               // Stamped edge of the last window.
+static int16_t s_iPrevCount = 0;
+static volatile int16_t s_iRpm = 0;
+static volatile uint8_t s_iMode = TACH_PERIOD;
+
+// --------------------------------------------------------
+// Tach_Setup()
+// Loads the settings from EEPROM, and starts the tach.
+void Tach_Setup()
+{
+	Tach_Stop();
+	uint8_t type = eeprom_read_byte(&eeTachType);
+	if(type == TACH_RIPPLE)
+	{
+		s_iType = type;
+		Ripple_Setup();
+		return;
+	}
+	if(type != TACH_PULSE && type != TACH_QUAD) return;
+	uint32_t cpr = eeprom_read_word(&eeTachPpr);
+	if(cpr == 0) cpr = 1;
+	if(type == TACH_QUAD) cpr *= 4;
+	s_iK = ((60UL * F_CPU) << TACH_FRAC) / cpr;
+
+	BitOff(DDRD, DSpare2);
+	BitOff(DDRD, DSpare3);
+	BitOn(PORTD, DSpare2);
+	BitOn(PORTD, DSpare3);
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		s_iType = type;
+		s_iAB = TACH_AB();
+		s_iCount = 0;
+		s_iEdgeCount = 0;
+		s_bPrev = False;
+		s_iPrevCount = 0;
+		s_iRpm = 0;
+		s_iMode = TACH_PERIOD;
+		s_bStampAll = True;
+		s_bStamp = True;
+		PCMSK3 = (type == TACH_QUAD) ? (_BV(PCINT26) | _BV(PCINT27)) : _BV(PCINT26);
+		PCIFR = _BV(PCIF3);
+		BitOn(PCICR, PCIE3);
+	}
+}
+
+// Stops the tach, and leaves the pins as plain inputs.
+void Tach_Stop()
+{
+	Ripple_Stop();
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		BitOff(PCICR, PCIE3);
+		PCMSK3 = 0;
+		s_iType = TACH_OFF;
+		s_iRpm = 0;
+	}
+	BitOff(PORTD, DSpare2);
+	BitOff(PORTD, DSpare3);
+}
+
+// Pin change on PD2 or PD3.
+ISR(PCINT3_vect)
+{
+	uint8_t ab = TACH_AB();
+	if(s_iType == TACH_QUAD)
+	{
+		int8_t d = pgm_read_byte(&s_QuadStep[(s_iAB << 2) | ab]);
+		s_iAB = ab;
+		if(d == 0) return;
+		s_iCount += d;
+	}
+	else
+	{
+		if(!(ab & 1)) return;        // Falling edge.
+		s_iCount++;
+	}
+	if(s_bStamp)
+	{
+		s_iEdgeTime = PWM_GetCycles();
+		s_iEdgeCount = s_iCount;
+		s_bStamp = s_bStampAll;
+	}
+}
+
+// --------------------------------------------------------
+// Tach_Tick()
+// Works out the RPM for the window just ended, and picks the
+// mode for the next.  Runs once per PWM tick, from Control_Tick().
+// At the fast PWM rates the tick runs with interrupts on, so the
+// edge is taken atomically.
+void Tach_Tick()
+{
+	if(s_iType != TACH_PULSE && s_iType != TACH_QUAD) return;
+	uint32_t t;
+	int16_t c;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		t = s_iEdgeTime;
+		c = s_iEdgeCount;
+		if(!s_bStampAll) s_bStamp = True;   // Stamp the first edge of the next window.
+	}
+	int16_t edges = c - s_iPrevCount;
+
+	if(edges == 0 || !s_bPrev)
+	{
+		// No edge stamped this window.  Make sure the RPM is no more than
+		// one edge in the time since the last edge would give.
+		uint32_t since = PWM_GetCycles() - t;
+		if(!s_bPrev || since > TACH_TIMEOUT) s_iRpm = 0;
+		else
+		{
+			uint32_t most = s_iK / ((since << TACH_FRAC) + 1);
+			if(s_iRpm > (int32_t) most) s_iRpm = most;
+			if(s_iRpm < -(int32_t) most) s_iRpm = -(int32_t) most;
+		}
+		if(edges != 0) s_bPrev = True;
+	}
+	else
+	{
+		uint16_t n = (edges < 0) ? -edges : edges;
+		uint32_t dt = t - s_iPrevTime;
+		if(dt > TACH_TIMEOUT)
+		{
+			// Starting from a stop.  One edge after a long wait is not a speed.
+			s_iRpm = 0;
+		}
+		else
+		{
+			uint32_t per = (dt << TACH_FRAC) / n;    // Cycles per edge.
+			uint32_t rpm = (per == 0) ? TACH_MAXRPM : s_iK / per;
+			if(rpm > TACH_MAXRPM) rpm = TACH_MAXRPM;
+			s_iRpm = (edges < 0) ? -(int16_t) rpm : (int16_t) rpm;
+		}
+		if(s_iMode == TACH_PERIOD && n >= TACH_TOCOUNT)
+		{
+			s_iMode = TACH_COUNT;
+			s_bStampAll = False;
+		}
+		else if(s_iMode == TACH_COUNT && n < TACH_TOPERIOD)
+		{
+			s_iMode = TACH_PERIOD;
+			s_bStampAll = True;
+			s_bStamp = True;
+		}
+	}
+	s_iPrevTime = t;
+	s_iPrevCount = c;
+}
+
+// Returns the speed, in RPM.  Negative if an encoder is turning
+// backward.
+int16_t Tach_GetRpm()
+{
+	if(s_iType == TACH_RIPPLE) return Ripple_GetRpm();
+	int16_t v;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { v = s_iRpm; }
+	return v;
+}
+
+// Returns the measurement mode, TACH_PERIOD or TACH_COUNT.
+uint8_t Tach_GetMode()
+{
+	return s_iMode;
+}
+
+// Returns the sensor type running, TACH_xxx.
+uint8_t Tach_GetType()
+{
+	return s_iType;
+}
+
+// Returns the name of a sensor type.
+PGM_P Tach_TypeName(uint8_t iType)
+{
+	if(iType > TACH_RIPPLE) iType = TACH_OFF;
+	return (PGM_P) pgm_read_word(&s_TypeNames[iType]);
+}
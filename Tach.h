@@ -0,0 +1,36 @@
+/*
+ * Tach.h
+ *
+ * Speed feedback from a tach or a quadrature encoder on the spare PD2
+ * and PD3 pins.
+ *
+ * Created: 10/18/2026
+ */
+
+#ifndef TACH_H_
+#define TACH_H_
+
+#include "MainDef.h"
+
+// Sensor types.
+#define TACH_OFF     0      // No speed feedback.
+#define TACH_PULSE   1      // Single pulse tach on DSpare2, rising edges counted.
+#define TACH_QUAD    2      // Quadrature encoder, A on DSpare2 and B on DSpare3, all edges counted.
+#define TACH_RIPPLE  3      // No sensor.  Speed from the current ripple (see Ripple.c).
+
+// Measurement modes, picked automatically from the edge rate.
+#define TACH_PERIOD  0      // Every edge timed.  For low speeds.
+#define TACH_COUNT   1      // Edges counted over the window.  For high speeds.
+
+EEu8(eeTachType, TACH_OFF);     // TACH_xxx.
+EEu16(eeTachPpr, 1);            // Pulses per rev, or encoder lines per rev.
+
+void Tach_Setup();
+void Tach_Stop();
+void Tach_Tick();
+int16_t Tach_GetRpm();
+uint8_t Tach_GetMode();
+uint8_t Tach_GetType();
+PGM_P Tach_TypeName(uint8_t iType);
+
+#endif /* TACH_H_ */
@@ -0,0 +1,148 @@
+/*
+ * Thermal.c
+ *
+ * I^2t thermal model of the motor.  The heat in the windings goes as the
+ * square of the current, and leaks away at a rate that goes as the heat.
+ * So the heat H follows the square of the current, through a first order
+ * lag with the time constant of the motor:
+ *
+ *     H += (u - H) * a,    u = (I / Irated)^2,    a = 1 - exp(-dt / tau)
+ *
+ * H is 1.0 (100%) after a long run at the rated current.  It is worked out
+ * once per control tick (dt = 1/PWM_TICKRATE), from Control_Tick().  Above
+ * eeThermWarn the output is derated, in a straight line from full at the
+ * warning level to TH_MINDERATE at the trip level, and at eeThermTrip the
+ * output is cut.  H is only cleared at power on, so going in and out of
+ * run mode doesn't forget how hot the motor is.
+ *
+ * Fixed point: u and H are Q24 (1.0 = 2^24), and u is limited to 16.0
+ * (four times the rated current).  a is tiny (about 1/3000 for a one minute
+ * time constant), so it is kept from a table of a in Q32, one for each time
+ * constant, worked out at compile time.  At setup, a is split into a 15 bit
+ * multiplier and a shift, so the update is one 16 x 16 multiply:
+ *
+ *     H += ((u - H) >> 13) * m >> (s - 13),    a = m / 2^s
+ *
+ * Created: 10/18/2026
+ */
+
+#include "MainDef.h"
+#include "ADC.h"
+#include "PWM.h"
+#include "Thermal.h"
+
+#define TH_ONE        (1UL << 24)       // 1.0 in Q24.
+#define TH_MAXU       16384             // Largest I / Irated, in Q12.
+#define TH_MINDERATE  1024              // Derate at the trip level, Q12.
+
+// a = 1 - exp(-dt / tau), in Q32.
+#define TH_A(tau)     ((uint32_t) (-__builtin_expm1(-1.0 / (PWM_TICKRATE * (tau))) * 4294967296.0 + 0.5))
+#define TH_ENTRY(tau) {tau, TH_A(tau)}
+
+typedef struct
+{
+	uint16_t Tau;              // Time constant, in secs.
+	uint32_t A;                // a, in Q32.
+} ThTau;
+
+static const ThTau s_Taus[TH_NTAUS] PROGMEM =
+{
+	TH_ENTRY(10),   TH_ENTRY(15),   TH_ENTRY(20),   TH_ENTRY(30),
+	TH_ENTRY(45),   TH_ENTRY(60),   TH_ENTRY(90),   TH_ENTRY(120),
+	TH_ENTRY(180),  TH_ENTRY(240),  TH_ENTRY(300),  TH_ENTRY(450),
+	TH_ENTRY(600),  TH_ENTRY(900),  TH_ENTRY(1200), TH_ENTRY(1800)
+};
+
+static uint16_t s_iRated = 1;          // Settings, loaded from EEPROM.
+static uint32_t s_iWarn = 0;           // Levels, Q24.
+static uint32_t s_iTrip = 0;
+static uint16_t s_iMul = 0;            // a = s_iMul / 2^s_iShift.
+static uint8_t  s_iShift = 32;
+static volatile int32_t s_iHeat = 0;   // H, Q24.
+static volatile uint16_t s_iDerate = 4096;   // Q12.
+
+// --------------------------------------------------------
+// Thermal_Setup()
+// Loads the settings from EEPROM.  The heat is kept.
+void Thermal_Setup()
+{
+	uint8_t iTau = eeprom_read_byte(&eeThermTau);
+	if(iTau >= TH_NTAUS) iTau = TH_NTAUS - 1;
+	uint32_t a = pgm_read_dword(&s_Taus[iTau].A);
+	uint8_t s = 32;
+	while(a >= 0x8000)
+	{
+		a >>= 1;
+		s--;
+	}
+	uint16_t rated = eeprom_read_word(&eeThermRated);
+	uint8_t warn = eeprom_read_byte(&eeThermWarn);
+	uint8_t trip = eeprom_read_byte(&eeThermTrip);
+	if(rated == 0) rated = 1;
+	if(trip <= warn) trip = warn + 1;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		s_iMul = a;
+		s_iShift = s;
+		s_iRated = rated;
+		s_iWarn = (TH_ONE / 100) * warn;
+		s_iTrip = (TH_ONE / 100) * trip;
+	}
+}
+
+// --------------------------------------------------------
+// Thermal_Tick()
+// Updates the heat from the current, and the derate.  Runs
+// once per PWM tick.  Returns True if over the trip level.
+bool8 Thermal_Tick()
+{
+	int16_t amps = ADC_GetCurrent();
+	if(amps < 0) amps = -amps;
+	uint32_t x = ((uint32_t) amps << 12) / s_iRated;
+	if(x > TH_MAXU) x = TH_MAXU;
+	int32_t u = x * x;
+	int32_t h = s_iHeat;
+	h += (((u - h) >> 13) * (int32_t) s_iMul) >> (s_iShift - 13);
+	if(h < 0) h = 0;
+
+	uint16_t d;
+	if((uint32_t) h <= s_iWarn) d = 4096;
+	else if((uint32_t) h >= s_iTrip) d = TH_MINDERATE;
+	else
+	{
+		uint32_t over = ((uint32_t) h - s_iWarn) >> 8;
+		uint32_t span = (s_iTrip - s_iWarn) >> 8;
+		d = 4096 - (over * (4096 - TH_MINDERATE)) / span;
+	}
+	// The tick can be interrupted (at the fast PWM rates), and the
+	// derate is read from other interrupts.
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		s_iHeat = h;
+		s_iDerate = d;
+	}
+	return (uint32_t) h >= s_iTrip;
+}
+
+// Returns the heat, in % of the heat at the rated current.
+uint16_t Thermal_GetPercent()
+{
+	int32_t h;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { h = s_iHeat; }
+	return ((uint32_t) (h >> 8) * 100) >> 16;
+}
+
+// Returns the factor the output is derated by, Q12 (4096 = none).
+uint16_t Thermal_GetDerate()
+{
+	uint16_t d;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { d = s_iDerate; }
+	return d;
+}
+
+// Returns a time constant from the table, in secs.
+uint16_t Thermal_GetTau(uint8_t iTau)
+{
+	if(iTau >= TH_NTAUS) iTau = TH_NTAUS - 1;
+	return pgm_read_word(&s_Taus[iTau].Tau);
+}
@@ -0,0 +1,27 @@
+/*
+ * Thermal.h
+ *
+ * I^2t thermal model of the motor, for overload protection.
+ *
+ * Created: 10/18/2026
+ */
+
+#ifndef THERMAL_H_
+#define THERMAL_H_
+
+#include "MainDef.h"
+
+#define TH_NTAUS   16          // Time constants to choose from.  See Thermal_GetTau().
+
+EEu8(eeThermTau, 5);            // Time constant of the motor, as an index into the table (60 sec).
+EEu16(eeThermRated, 2000);      // Rated (continuous) current, in 100th of Amps.
+EEu8(eeThermWarn, 100);         // Heat at which the output is derated, in % of the heat at the rated current.
+EEu8(eeThermTrip, 130);         // Heat at which the output is cut, in %.
+
+void Thermal_Setup();
+bool8 Thermal_Tick();
+uint16_t Thermal_GetPercent();
+uint16_t Thermal_GetDerate();
+uint16_t Thermal_GetTau(uint8_t iTau);
+
+#endif /* THERMAL_H_ */
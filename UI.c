@@ -35,6 +35,7 @@
 
 #include "MainDef.h"
 #include "SysClock.h"   // Needed for Debounce
+#include "Sched.h"      // Deferred timers run while waiting on buttons
 #include "KKLcd.h"      // Needed for LCD Display
 #include "Utility.h"    // Needed for string conversion
 #include "UI.h"
@@ -557,6 +558,23 @@ void UI_Box(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1)
     KKLcd_Box(x0, MAX_Y - y0 - 1, x1, MAX_Y - y1 - 1);
 }
 
+// --------------------------------------------------------
+// UI_Bar()
+// Draws a bar graph: a box, given the two corners, filled
+// from the left for n pixels.  The rest of the inside is
+// cleared, so the bar can be redrawn in place.
+void UI_Bar(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1, uint8_t n)
+{
+    UI_Box(x0, y0, x1, y1);
+    for(uint8_t x = x0 + 1; x < x1; x++)
+    {
+        for(uint8_t y = y0 + 1; y < y1; y++)
+        {
+            KKLcd_SetPixel(x, MAX_Y - y - 1, x <= x0 + n);
+        }
+    }
+}
+
 // --------------------------------------------------------
 // UI_MsgBoxS()
 // Writes a message in a box, and waits for the user
@@ -721,6 +739,17 @@ void UI_Update()
     giUiY = 0;
 }
 
+// --------------------------------------------------------
+// UI_GetButtons()
+// Returns the buttons held down, as a mask of UI_B0, UI_B1
+// and UI_B2.  Every loop that waits on the user calls this,
+// so the deferred timers (see Sched.c) are run from here.
+uint8_t UI_GetButtons()
+{
+    Sched_Poll();
+    return GetButtons();
+}
+
 // --------------------------------------------------------
 // UI_WaitButton()
 // Waits on one button and debounces click before returning.
@@ -860,7 +889,7 @@ void UI_Menu(PGM_P pTitle, MenuItem *pItems, uint8_t nItems)
             {
                 pItems[iMenuPosition].ServiceRoutine(pItems + iMenuPosition);
             }
-            else if(pItems->pValue)
+            else if(pItems[iMenuPosition].pValue || (pItems[iMenuPosition].AccessFlag & U_ROM))
             {
                 UI_ParamEdit(pItems + iMenuPosition);
             }
@@ -15,8 +15,7 @@
 #define UI_B1 _BV(Button_1)
 #define UI_B2 _BV(Button_2)
 
-#define UI_TestButton(b) (GetButtons() & b)
-#define UI_GetButtons()  GetButtons()
+#define UI_TestButton(b) (UI_GetButtons() & b)
 
 #define MAXNUMCHARS 20       // Maximum number of characters for numeric output.
 
@@ -61,6 +60,7 @@ void UI_ParamL(PGM_P name, int16_t v, uint8_t Format);
 
 void UI_Line(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1);
 void UI_Box(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1);
+void UI_Bar(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1, uint8_t n);
 
 void UI_MsgBoxS(PGM_P pTitle, const char *pMsg);
 void UI_MsgBoxM(PGM_P pTitle, const char *pMsg);
@@ -72,6 +72,7 @@ void UI_NewScreen(PGM_P pTitle);
 
 void UI_Clear();
 void UI_Update();
+uint8_t UI_GetButtons();
 
 void UI_WaitButton(uint8_t Button);
 uint8_t UI_WaitAnyButton();